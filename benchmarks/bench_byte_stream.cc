@@ -0,0 +1,203 @@
+#include "byte_stream.hh"
+#include "concurrent_byte_stream.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Count every heap allocation made by the process, so that each run can report allocations per operation.
+static atomic<uint64_t> allocations{0};
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, memory_order_relaxed);
+    if (void *ret = malloc(size)) {
+        return ret;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+
+void operator delete(void *ptr, size_t /* unused */) noexcept { free(ptr); }
+
+//! How the reader consumes bytes from the stream
+enum class Pattern { Read, PeekPop, ViewsPop };
+
+static const char *pattern_name(const Pattern pattern) {
+    switch (pattern) {
+        case Pattern::Read:
+            return "read";
+        case Pattern::PeekPop:
+            return "peek_output+pop";
+        case Pattern::ViewsPop:
+            return "peek_views+pop";
+    }
+    return "unknown";
+}
+
+//! One benchmark configuration and its measurements
+struct Result {
+    string stream;
+    unsigned threads;
+    size_t capacity;
+    size_t write_size;
+    Pattern pattern;
+    uint64_t bytes;
+    uint64_t ops;
+    double seconds;
+    uint64_t allocations;
+};
+
+//! Consume up to `len` bytes according to `pattern`
+//! \returns the number of bytes consumed
+template <typename StreamT>
+static size_t consume(StreamT &stream, const size_t len, const Pattern pattern, uint64_t &checksum) {
+    switch (pattern) {
+        case Pattern::Read: {
+            const string data = stream.read(len);
+            checksum += data.empty() ? 0 : uint8_t(data.front());
+            return data.size();
+        }
+        case Pattern::PeekPop: {
+            const string data = stream.peek_output(len);
+            checksum += data.empty() ? 0 : uint8_t(data.front());
+            stream.pop_output(data.size());
+            return data.size();
+        }
+        case Pattern::ViewsPop: {
+            const BufferViewList views = stream.peek_views(len);
+            const size_t size = views.size();
+            checksum += size;
+            stream.pop_output(size);
+            return size;
+        }
+    }
+    return 0;
+}
+
+//! Move `total` bytes through `stream`, writing and consuming on the calling thread
+template <typename StreamT>
+static Result single_thread(const string &name,
+                            const size_t capacity,
+                            const size_t write_size,
+                            const Pattern pattern,
+                            const uint64_t total) {
+    StreamT stream{capacity};
+    const string chunk(write_size, 'x');
+    uint64_t checksum = 0, ops = 0, moved = 0;
+
+    const uint64_t allocations_before = allocations.load();
+    const auto start = chrono::steady_clock::now();
+    while (moved < total) {
+        stream.write(chunk);
+        moved += consume(stream, write_size, pattern, checksum);
+        ++ops;
+    }
+    const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    const uint64_t allocations_after = allocations.load();
+
+    if (checksum == 0) {
+        throw runtime_error("no bytes were consumed");
+    }
+    return {name, 1, capacity, write_size, pattern, moved, ops, elapsed.count(), allocations_after - allocations_before};
+}
+
+//! Move `total` bytes through a ConcurrentByteStream from a writer thread to the calling thread
+static Result cross_thread(const size_t capacity, const size_t write_size, const Pattern pattern, const uint64_t total) {
+    ConcurrentByteStream stream{capacity};
+    const string chunk(write_size, 'x');
+    uint64_t checksum = 0, ops = 0, moved = 0;
+
+    const uint64_t allocations_before = allocations.load();
+    const auto start = chrono::steady_clock::now();
+    thread writer([&] {
+        for (uint64_t written = 0; written < total;) {
+            const size_t accepted = stream.write(string_view(chunk).substr(0, min<uint64_t>(write_size, total - written)));
+            if (accepted == 0) {
+                this_thread::yield();
+            }
+            written += accepted;
+        }
+        stream.end_input();
+    });
+    while (not stream.eof()) {
+        const size_t consumed = consume(stream, write_size, pattern, checksum);
+        if (consumed == 0) {
+            this_thread::yield();  // an empty poll is not an operation
+            continue;
+        }
+        moved += consumed;
+        ++ops;
+    }
+    writer.join();
+    const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    const uint64_t allocations_after = allocations.load();
+
+    return {"ConcurrentByteStream",
+            2,
+            capacity,
+            write_size,
+            pattern,
+            moved,
+            ops,
+            elapsed.count(),
+            allocations_after - allocations_before};
+}
+
+static void print_json(ostream &out, const vector<Result> &results) {
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto &r = results[i];
+        out << "  {\"stream\": \"" << r.stream << "\", \"threads\": " << r.threads << ", \"capacity\": " << r.capacity
+            << ", \"write_size\": " << r.write_size << ", \"pattern\": \"" << pattern_name(r.pattern)
+            << "\", \"bytes\": " << r.bytes << ", \"ops\": " << r.ops << ", \"seconds\": " << r.seconds
+            << ", \"gb_per_s\": " << (r.bytes / r.seconds / 1e9) << ", \"ns_per_op\": " << (r.seconds * 1e9 / r.ops)
+            << ", \"allocs_per_op\": " << (double(r.allocations) / r.ops) << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        if (argc <= 0) {
+            abort();
+        }
+        if (argc > 2) {
+            cerr << "Usage: " << argv[0] << " [BYTES_PER_RUN]\n";
+            return EXIT_FAILURE;
+        }
+        const uint64_t total = argc == 2 ? stoull(argv[1]) : uint64_t(64) * 1024 * 1024;
+
+        vector<Result> results;
+        for (const size_t capacity : {4096, 65536, 1048576}) {
+            for (const size_t write_size : {64, 1460, 16384}) {
+                if (write_size > capacity) {
+                    continue;
+                }
+                for (const Pattern pattern : {Pattern::Read, Pattern::PeekPop, Pattern::ViewsPop}) {
+                    results.push_back(single_thread<ByteStream>("ByteStream", capacity, write_size, pattern, total));
+                    results.push_back(single_thread<ConcurrentByteStream>(
+                        "ConcurrentByteStream", capacity, write_size, pattern, total));
+                    results.push_back(cross_thread(capacity, write_size, pattern, total));
+                }
+            }
+        }
+
+        print_json(cout, results);
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -18,3 +18,9 @@ endif ()
 set (CMAKE_CXX_FLAGS_DEBUG "${CMAKE_CXX_FLAGS_DEBUG} -ggdb3 -Og")
 set (CMAKE_CXX_FLAGS_DEBUGASAN "${CMAKE_CXX_FLAGS_DEBUG} -fsanitize=undefined -fsanitize=address")
 set (CMAKE_CXX_FLAGS_RELASAN "${CMAKE_CXX_FLAGS_RELEASE} -fsanitize=undefined -fsanitize=address")
+
+# non-atomic reference counts for Buffer storage, for programs whose Buffers never leave the thread that made them
+option (SPONGE_LOCAL_REFCOUNT "Give Buffer storage non-atomic, single-thread reference counts" OFF)
+if (SPONGE_LOCAL_REFCOUNT)
+    add_definitions (-DSPONGE_LOCAL_REFCOUNT)
+endif ()
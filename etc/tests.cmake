@@ -36,6 +36,19 @@ add_test(NAME t_byte_stream_one_write    COMMAND byte_stream_one_write)
 add_test(NAME t_byte_stream_two_writes   COMMAND byte_stream_two_writes)
 add_test(NAME t_byte_stream_capacity     COMMAND byte_stream_capacity)
 add_test(NAME t_byte_stream_many_writes  COMMAND byte_stream_many_writes)
+add_test(NAME t_byte_stream_adopt        COMMAND byte_stream_adopt)
+add_test(NAME t_byte_stream_scatter      COMMAND byte_stream_scatter)
+add_test(NAME t_byte_stream_fd           COMMAND byte_stream_fd)
+
+add_test(NAME t_buffer_list              COMMAND buffer_list)
+add_test(NAME t_buffer_pool              COMMAND buffer_pool)
+add_test(NAME t_fd_read                  COMMAND fd_read)
+add_test(NAME t_fd_splice                COMMAND fd_splice)
+add_test(NAME t_eventloop                COMMAND eventloop)
+add_test(NAME t_timer_wheel              COMMAND timer_wheel)
+add_test(NAME t_eventloop_group          COMMAND eventloop_group)
+add_test(NAME t_udp_batch                COMMAND udp_batch)
+add_test(NAME t_byte_stream_concurrent   COMMAND byte_stream_concurrent)
 
 add_test(NAME t_webget               COMMAND "${PROJECT_SOURCE_DIR}/tests/webget_t.sh")
 
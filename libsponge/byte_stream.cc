@@ -1,53 +1,214 @@
 #include "byte_stream.hh"
 
-// Dummy implementation of a flow-controlled in-memory byte stream.
+#include "util.hh"
 
-// For Lab 0, please replace with a real implementation that passes the
-// automated checks run by `make check_lab0`.
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <utility>
 
-// You will need to add private members to the class declaration in `byte_stream.hh`
-
-template <typename... Targs>
-void DUMMY_CODE(Targs &&... /* unused */) {}
+// Flow-controlled in-memory byte stream backed by a fixed-size ring buffer.
 
 using namespace std;
 
-ByteStream::ByteStream(const size_t capacity) { DUMMY_CODE(capacity); }
+//! \param[in] capacity is the maximum number of bytes the stream will hold at once
+ByteStream::ByteStream(const size_t capacity)
+    : _ring(next_power_of_two(capacity), 0), _mask(_ring.size() - 1), _capacity(capacity) {}
+
+//! \param[in] data is copied into the ring, wrapping around its end if needed
+//! \details The ring never holds more than the stream does, so anything that fits in the stream fits in the ring.
+void ByteStream::copy_in(const string_view data) {
+    const size_t start = _ring_written & _mask;
+    const size_t first = min(data.size(), _ring.size() - start);
+    memcpy(_ring.data() + start, data.data(), first);
+    memcpy(_ring.data(), data.data() + first, data.size() - first);
+    _ring_written += data.size();
+    _ring_tail += data.size();
+    _bytes_written += data.size();
+}
 
+//! \param[in] len is the number of bytes to visit; must not exceed buffer_size()
+//! \param[in] visit is called with a `std::string_view` of each piece (at most two per run of ring bytes,
+//!                  since a run may wrap around the end of the ring, and one per adopted chunk)
+template <typename T>
+void ByteStream::for_each_piece(size_t len, const T &visit) const {
+    size_t ring_index = _ring_read;
+    const auto visit_ring = [&](const size_t n) {
+        const size_t start = ring_index & _mask;
+        const size_t first = min(n, _ring.size() - start);
+        visit(string_view{_ring.data() + start, first});
+        if (n > first) {
+            visit(string_view{_ring.data(), n - first});
+        }
+        ring_index += n;
+    };
+
+    for (auto chunk = _adopted.begin(); chunk != _adopted.end() and len > 0; ++chunk) {
+        const size_t from_ring = min(len, chunk->ring_before);
+        if (from_ring > 0) {
+            visit_ring(from_ring);
+            len -= from_ring;
+        }
+        const string_view bytes = chunk->buffer.str().substr(0, len);
+        if (not bytes.empty()) {
+            visit(bytes);
+            len -= bytes.size();
+        }
+    }
+    if (len > 0) {
+        visit_ring(len);
+    }
+}
+
+//! \param[in] data is the string whose bytes are appended to the stream, as many as fit
+//! \returns the number of bytes accepted into the stream
 size_t ByteStream::write(const string &data) {
-    DUMMY_CODE(data);
-    return {};
+    const size_t len = min(data.size(), remaining_capacity());
+    copy_in({data.data(), len});
+    return len;
+}
+
+//! \param[in] data holds the fragments whose bytes are appended to the stream, as many as fit
+//! \returns the number of bytes accepted into the stream
+//! \details Capacity is checked once for the whole list, and then each fragment is copied
+//! straight into the ring, so there is no intermediate concatenation.
+size_t ByteStream::write(const BufferViewList &data) {
+    size_t budget = remaining_capacity();
+    size_t len = 0;
+    for (auto it = data.views().begin(); it != data.views().end() and budget > 0; ++it) {
+        const string_view fragment = it->substr(0, budget);
+        copy_in(fragment);
+        len += fragment.size();
+        budget -= fragment.size();
+    }
+    return len;
+}
+
+//! \param[in] data is the string whose bytes are appended to the stream, as many as fit
+//! \returns the number of bytes accepted into the stream
+//! \details Payloads smaller than ADOPT_THRESHOLD are copied into the ring, which is cheaper
+//! than allocating a reference count for them.
+size_t ByteStream::write(string &&data) {
+    if (data.size() < ADOPT_THRESHOLD) {
+        return write(static_cast<const string &>(data));
+    }
+    return write(Buffer(move(data)));
+}
+
+//! \param[in] data is the Buffer whose bytes are appended to the stream, as many as fit
+//! \returns the number of bytes accepted into the stream
+//! \details If capacity is short, only a prefix of `data` is accepted; the caller can
+//! drop it with Buffer::remove_prefix and offer the rest again later.
+size_t ByteStream::write(Buffer data) {
+    const size_t len = min(data.size(), remaining_capacity());
+    if (len == 0) {
+        return 0;
+    }
+    data.remove_suffix(data.size() - len);
+    _adopted.push_back({_ring_tail, move(data)});
+    _ring_tail = 0;
+    _adopted_size += len;
+    _bytes_written += len;
+    return len;
+}
+
+//! \param[in] fd is the file descriptor to read from
+//! \param[in] limit is the maximum number of bytes to read; fewer are read if the stream is short of room
+//! \returns the number of bytes accepted into the stream
+//! \details The stream's free space (up to two regions of the ring) is passed straight to
+//! [readv(2)](\ref man2::readv), so the bytes land in the ring with no intermediate buffer.
+size_t ByteStream::read_from(FileDescriptor &fd, const size_t limit) {
+    const size_t len = min(limit, remaining_capacity());
+    const size_t start = _ring_written & _mask;
+    const size_t first = min(len, _ring.size() - start);
+    const array<iovec, 2> iovecs{{{_ring.data() + start, first}, {_ring.data(), len - first}}};
+    const size_t bytes_read = fd.readv(iovecs.data(), len > first ? 2 : 1);
+    _ring_written += bytes_read;
+    _ring_tail += bytes_read;
+    _bytes_written += bytes_read;
+    return bytes_read;
 }
 
 //! \param[in] len bytes will be copied from the output side of the buffer
 string ByteStream::peek_output(const size_t len) const {
-    DUMMY_CODE(len);
-    return {};
+    const size_t size = min(len, buffer_size());
+    string ret;
+    ret.reserve(size);
+    for_each_piece(size, [&](const string_view piece) { ret.append(piece); });
+    return ret;
+}
+
+//! \param[in] len bytes will be exposed from the output side of the buffer
+//! \details The views point directly into the ring and the adopted chunks, so they can be
+//! handed to FileDescriptor::write (and so to [writev(2)](\ref man2::writev)) without a copy.
+BufferViewList ByteStream::peek_views(const size_t len) const {
+    BufferViewList ret;
+    for_each_piece(min(len, buffer_size()), [&](const string_view piece) { ret.append(piece); });
+    return ret;
 }
 
 //! \param[in] len bytes will be removed from the output side of the buffer
-void ByteStream::pop_output(const size_t len) { DUMMY_CODE(len); }
+void ByteStream::pop_output(const size_t len) {
+    size_t remaining = min(len, buffer_size());
+    _bytes_read += remaining;
+
+    // pop the chunks, and the ring bytes before each, in stream order
+    while (remaining > 0 and not _adopted.empty()) {
+        AdoptedChunk &chunk = _adopted.front();
+        const size_t from_ring = min(remaining, chunk.ring_before);
+        chunk.ring_before -= from_ring;
+        _ring_read += from_ring;
+        remaining -= from_ring;
+
+        const size_t from_chunk = min(remaining, chunk.buffer.size());
+        chunk.buffer.remove_prefix(from_chunk);
+        _adopted_size -= from_chunk;
+        remaining -= from_chunk;
+        if (chunk.buffer.size() == 0) {
+            _adopted.pop_front();
+        }
+    }
+
+    // then the ring bytes after the last chunk
+    _ring_read += remaining;
+    _ring_tail -= remaining;
+}
 
 //! Read (i.e., copy and then pop) the next "len" bytes of the stream
 //! \param[in] len bytes will be popped and returned
 //! \returns a string
 std::string ByteStream::read(const size_t len) {
-    DUMMY_CODE(len);
-    return {};
+    string ret = peek_output(len);
+    pop_output(ret.size());
+    return ret;
+}
+
+//! \param[in] fd is the file descriptor to write to
+//! \param[in] limit is the maximum number of bytes to write
+//! \returns the number of bytes written to `fd` (and popped from the stream)
+//! \details The stream's contents are handed to [writev(2)](\ref man2::writev) in place, via
+//! peek_views(); a short write pops only what the kernel accepted.
+size_t ByteStream::write_to(FileDescriptor &fd, const size_t limit) {
+    if (buffer_empty() or limit == 0) {
+        return 0;
+    }
+    const size_t bytes_written = fd.write(peek_views(limit), false);
+    pop_output(bytes_written);
+    return bytes_written;
 }
 
-void ByteStream::end_input() {}
+void ByteStream::end_input() { _input_ended = true; }
 
-bool ByteStream::input_ended() const { return {}; }
+bool ByteStream::input_ended() const { return _input_ended; }
 
-size_t ByteStream::buffer_size() const { return {}; }
+size_t ByteStream::buffer_size() const { return _bytes_written - _bytes_read; }
 
-bool ByteStream::buffer_empty() const { return {}; }
+bool ByteStream::buffer_empty() const { return buffer_size() == 0; }
 
-bool ByteStream::eof() const { return false; }
+bool ByteStream::eof() const { return _input_ended and buffer_empty(); }
 
-size_t ByteStream::bytes_written() const { return {}; }
+size_t ByteStream::bytes_written() const { return _bytes_written; }
 
-size_t ByteStream::bytes_read() const { return {}; }
+size_t ByteStream::bytes_read() const { return _bytes_read; }
 
-size_t ByteStream::remaining_capacity() const { return {}; }
+size_t ByteStream::remaining_capacity() const { return _capacity - buffer_size(); }
@@ -1,6 +1,10 @@
 #ifndef SPONGE_LIBSPONGE_BYTE_STREAM_HH
 #define SPONGE_LIBSPONGE_BYTE_STREAM_HH
 
+#include "buffer.hh"
+#include "file_descriptor.hh"
+
+#include <limits>
 #include <string>
 
 //! \brief An in-order byte stream.
@@ -8,16 +12,41 @@
 //! Bytes are written on the "input" side and read from the "output"
 //! side.  The byte stream is finite: the writer can end the input,
 //! and then no more bytes can be written.
+//!
+//! The bytes live in a ring buffer that is allocated once, at
+//! construction, and never reallocated or shifted afterwards.
+//! Large payloads handed over by rvalue (see write(Buffer)) are
+//! instead adopted as reference-counted Buffer chunks, so they
+//! enter the stream without a copy. Each chunk records how many of
+//! the ring's bytes come before it, so bytes written after a chunk
+//! still go into the ring.
 class ByteStream {
   private:
-    // Your code here -- add private members as necessary.
-
-    // Hint: This doesn't need to be a sophisticated data structure at
-    // all, but if any of your tests are taking longer than a second,
-    // that's a sign that you probably want to keep exploring
-    // different approaches.
-
-    bool _error{};  //!< Flag indicating that the stream suffered an error.
+    //! A chunk adopted by write(Buffer), and its place among the bytes held in the ring
+    struct AdoptedChunk {
+        size_t ring_before = 0;  //!< Number of ring bytes between the previous chunk (or the front) and this one
+        Buffer buffer{};         //!< The chunk's bytes that have not been popped
+    };
+
+    std::string _ring;                        //!< Backing storage, a power of two no smaller than the capacity
+    size_t _mask;                             //!< `_ring.size() - 1`, maps a ring index to a position in `_ring`
+    size_t _capacity;                         //!< Maximum number of bytes held in the stream at once
+    size_t _ring_read{};                      //!< Total bytes popped from the ring; also the index of its first byte
+    size_t _ring_written{};                   //!< Total bytes put in the ring; also the index one past its last byte
+    size_t _ring_tail{};                      //!< Number of ring bytes after the last adopted chunk
+    InlineQueue<AdoptedChunk, 4> _adopted{};  //!< Adopted chunks that have bytes left, in stream order
+    size_t _adopted_size{};                   //!< Number of bytes held in `_adopted`
+    size_t _bytes_written{};                  //!< Total bytes accepted
+    size_t _bytes_read{};                     //!< Total bytes popped
+    bool _input_ended{};                      //!< Flag indicating that the writer has ended the input.
+    bool _error{};                            //!< Flag indicating that the stream suffered an error.
+
+    //! Copy `data` into the ring after the last stored byte (it must fit)
+    void copy_in(const std::string_view data);
+
+    //! Call `visit` with each contiguous piece of the first `len` bytes of the stream, in order
+    template <typename T>
+    void for_each_piece(size_t len, const T &visit) const;
 
   public:
     //! Construct a stream with room for `capacity` bytes.
@@ -31,6 +60,31 @@ class ByteStream {
     //! \returns the number of bytes accepted into the stream
     size_t write(const std::string &data);
 
+    //! Write a discontiguous string of bytes (e.g. a header and a payload) into
+    //! the stream in one pass. Write as many as will fit, and return how many were written.
+    //! \returns the number of bytes accepted into the stream
+    size_t write(const BufferViewList &data);
+
+    //! Write a C string (must be NULL-terminated) into the stream
+    //! \returns the number of bytes accepted into the stream
+    size_t write(const char *data) { return write(std::string_view(data)); }
+
+    //! Write a string of bytes into the stream, taking ownership of its storage
+    //! if it is large enough to be worth adopting rather than copying.
+    //! \returns the number of bytes accepted into the stream
+    size_t write(std::string &&data);
+
+    //! Write a Buffer into the stream by sharing its storage (no copy).
+    //! \returns the number of bytes accepted into the stream
+    size_t write(Buffer data);
+
+    //! Payloads at least this large are adopted by write(std::string &&) instead of copied
+    static constexpr size_t ADOPT_THRESHOLD = 4096;
+
+    //! Read up to `limit` bytes from `fd` directly into the stream's free space
+    //! \returns the number of bytes accepted into the stream
+    size_t read_from(FileDescriptor &fd, const size_t limit = std::numeric_limits<size_t>::max());
+
     //! \returns the number of additional bytes that the stream has space for
     size_t remaining_capacity() const;
 
@@ -48,6 +102,11 @@ class ByteStream {
     //! \returns a string
     std::string peek_output(const size_t len) const;
 
+    //! Peek at next "len" bytes of the stream without copying them
+    //! \returns views into the stream's storage (at most two per run of ring bytes, and one per adopted chunk)
+    //! \note The views are invalidated by the next call to write(), pop_output() or read()
+    BufferViewList peek_views(const size_t len) const;
+
     //! Remove bytes from the buffer
     void pop_output(const size_t len);
 
@@ -55,6 +114,10 @@ class ByteStream {
     //! \returns a string
     std::string read(const size_t len);
 
+    //! Write up to `limit` bytes from the stream directly to `fd`, and pop them
+    //! \returns the number of bytes written to `fd`
+    size_t write_to(FileDescriptor &fd, const size_t limit = std::numeric_limits<size_t>::max());
+
     //! \returns `true` if the stream input has ended
     bool input_ended() const;
 
@@ -0,0 +1,203 @@
+#include "concurrent_byte_stream.hh"
+
+#include "util.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// Single-producer/single-consumer byte stream backed by a fixed-size ring buffer.
+
+using namespace std;
+
+//! \param[in] capacity is the maximum number of bytes the stream will hold at once
+ConcurrentByteStream::ConcurrentByteStream(const size_t capacity)
+    : _ring(next_power_of_two(capacity), 0)
+    , _mask(_ring.size() - 1)
+    , _capacity(capacity)
+    , _read_event(SystemCall("eventfd", eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)))
+    , _write_event(SystemCall("eventfd", eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))) {}
+
+//! \param[in] timeout_ms is the total time allowed, or a negative number to wait forever
+//! \param[in] start is when the wait began, as returned by timestamp_ms()
+//! \returns the time left to wait, suitable as a [poll(2)](\ref man2::poll) timeout
+static int remaining_ms(const int timeout_ms, const uint64_t start) {
+    if (timeout_ms < 0) {
+        return -1;
+    }
+    const uint64_t elapsed = timestamp_ms() - start;
+    return elapsed >= uint64_t(timeout_ms) ? 0 : timeout_ms - int(elapsed);
+}
+
+//! \param[in] event is the eventfd to wait on
+//! \param[in] timeout_ms is passed to [poll(2)](\ref man2::poll)
+//! \returns `true` if `event` became readable, `false` on timeout or interruption by a signal
+static bool wait_for_event(const FileDescriptor &event, const int timeout_ms) {
+    pollfd pfd{event.fd_num(), POLLIN, 0};
+    return SystemCall("poll", ::poll(&pfd, 1, timeout_ms), EINTR) > 0;
+}
+
+//! \param[in,out] armed is the waiter's flag, cleared if it was set
+//! \param[in] event is the eventfd that the waiter is parked on
+//! \details The fence pairs with the one in arm_read_event() and arm_write_event(): either the
+//! waiter observes the update that the caller just published, or the caller observes `armed`.
+//! The eventfd is written directly, rather than via FileDescriptor::write, so that the
+//! FileDescriptor's counters are only ever touched by the waiting thread.
+void ConcurrentByteStream::signal_event(atomic<bool> &armed, FileDescriptor &event) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (armed.load(memory_order_relaxed) and armed.exchange(false)) {
+        const uint64_t one = 1;
+        SystemCall("write", ::write(event.fd_num(), &one, sizeof(one)));
+    }
+}
+
+//! \param[in] data is the string whose bytes are appended to the stream, as many as fit
+//! \returns the number of bytes accepted into the stream
+//! \details The bytes are copied into the free part of the ring before the new tail is
+//! published (release), so a reader that observes the tail (acquire) also observes them.
+size_t ConcurrentByteStream::write(const string_view data) {
+    const size_t tail = _bytes_written.load(memory_order_relaxed);
+    const size_t head = _bytes_read.load(memory_order_acquire);
+    const size_t len = min(data.size(), _capacity - (tail - head));
+
+    const size_t start = tail & _mask;
+    const size_t first = min(len, _ring.size() - start);
+    memcpy(_ring.data() + start, data.data(), first);
+    memcpy(_ring.data(), data.data() + first, len - first);
+
+    _bytes_written.store(tail + len, memory_order_release);
+    if (len > 0) {
+        signal_event(_read_event_armed, _read_event);
+    }
+    return len;
+}
+
+//! \param[in] data is the string whose bytes are appended to the stream
+//! \param[in] timeout_ms is the longest time to wait for room, or a negative number to wait forever
+//! \returns the number of bytes accepted, which is less than `data.size()` only on timeout or error
+size_t ConcurrentByteStream::write_wait(const string_view data, const int timeout_ms) {
+    const uint64_t start = timestamp_ms();
+    size_t written = write(data);
+    while (written < data.size() and not error()) {
+        arm_write_event();
+        const int wait_ms = remaining_ms(timeout_ms, start);
+        if (wait_for_event(_write_event, wait_ms)) {
+            clear_write_event();
+        } else if (wait_ms == 0) {
+            break;
+        }
+        written += write(data.substr(written));
+    }
+    return written;
+}
+
+void ConcurrentByteStream::end_input() {
+    _input_ended.store(true, memory_order_release);
+    signal_event(_read_event_armed, _read_event);
+}
+
+void ConcurrentByteStream::set_error() {
+    _error.store(true, memory_order_release);
+    signal_event(_read_event_armed, _read_event);
+    signal_event(_write_event_armed, _write_event);
+}
+
+size_t ConcurrentByteStream::remaining_capacity() const { return _capacity - buffer_size(); }
+
+//! \param[in] len bytes will be copied from the output side of the buffer
+string ConcurrentByteStream::peek_output(const size_t len) const {
+    const size_t head = _bytes_read.load(memory_order_relaxed);
+    const size_t tail = _bytes_written.load(memory_order_acquire);
+    string ret(min(len, tail - head), 0);
+
+    const size_t start = head & _mask;
+    const size_t first = min(ret.size(), _ring.size() - start);
+    memcpy(ret.data(), _ring.data() + start, first);
+    memcpy(ret.data() + first, _ring.data(), ret.size() - first);
+    return ret;
+}
+
+//! \param[in] len bytes will be exposed from the output side of the buffer
+BufferViewList ConcurrentByteStream::peek_views(const size_t len) const {
+    const size_t head = _bytes_read.load(memory_order_relaxed);
+    const size_t tail = _bytes_written.load(memory_order_acquire);
+    const size_t size = min(len, tail - head);
+
+    const size_t start = head & _mask;
+    const size_t first = min(size, _ring.size() - start);
+    BufferViewList ret;
+    ret.append({_ring.data() + start, first});
+    ret.append({_ring.data(), size - first});
+    return ret;
+}
+
+//! \param[in] len bytes will be removed from the output side of the buffer
+//! \details Publishing the new head (release) hands the popped part of the ring back to the writer.
+void ConcurrentByteStream::pop_output(const size_t len) {
+    const size_t head = _bytes_read.load(memory_order_relaxed);
+    const size_t tail = _bytes_written.load(memory_order_acquire);
+    const size_t size = min(len, tail - head);
+    _bytes_read.store(head + size, memory_order_release);
+    if (size > 0) {
+        signal_event(_write_event_armed, _write_event);
+    }
+}
+
+//! Read (i.e., copy and then pop) the next "len" bytes of the stream
+//! \param[in] len bytes will be popped and returned
+//! \returns a string
+string ConcurrentByteStream::read(const size_t len) {
+    string ret = peek_output(len);
+    pop_output(ret.size());
+    return ret;
+}
+
+//! \param[in] len is the maximum number of bytes to read
+//! \param[in] timeout_ms is the longest time to wait for data, or a negative number to wait forever
+//! \returns a string, which is empty if the wait timed out or the stream reached eof() or an error
+string ConcurrentByteStream::read_wait(const size_t len, const int timeout_ms) {
+    const uint64_t start = timestamp_ms();
+    while (buffer_empty() and not input_ended() and not error()) {
+        arm_read_event();
+        const int wait_ms = remaining_ms(timeout_ms, start);
+        if (wait_for_event(_read_event, wait_ms)) {
+            clear_read_event();
+        } else if (wait_ms == 0) {
+            return {};
+        }
+    }
+    return read(len);
+}
+
+size_t ConcurrentByteStream::buffer_size() const {
+    const size_t head = _bytes_read.load(memory_order_acquire);
+    const size_t tail = _bytes_written.load(memory_order_acquire);
+    return tail - head;
+}
+
+//! \details The input-ended flag is checked first: the writer sets it after publishing its
+//! last bytes, so once it is observed, an empty buffer really is the end of the stream.
+bool ConcurrentByteStream::eof() const { return input_ended() and buffer_empty(); }
+
+//! \details If the stream is already readable, read_event() is signaled immediately, so that a
+//! poll on it never misses data that arrived before the call.
+void ConcurrentByteStream::arm_read_event() {
+    _read_event_armed.store(true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (not buffer_empty() or input_ended() or error()) {
+        signal_event(_read_event_armed, _read_event);
+    }
+}
+
+//! \details If the stream already has room, write_event() is signaled immediately, so that a
+//! poll on it never misses space that was freed before the call.
+void ConcurrentByteStream::arm_write_event() {
+    _write_event_armed.store(true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (remaining_capacity() > 0 or error()) {
+        signal_event(_write_event_armed, _write_event);
+    }
+}
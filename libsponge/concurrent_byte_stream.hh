@@ -0,0 +1,173 @@
+#ifndef SPONGE_LIBSPONGE_CONCURRENT_BYTE_STREAM_HH
+#define SPONGE_LIBSPONGE_CONCURRENT_BYTE_STREAM_HH
+
+#include "buffer.hh"
+#include "file_descriptor.hh"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+//! \brief An in-order byte stream shared by one writer thread and one reader thread.
+
+//! ConcurrentByteStream has the same interface as ByteStream, but the "input" side may be
+//! used by one thread while the "output" side is used by another, with no locks. The bytes
+//! live in a power-of-two ring buffer allocated at construction; the running totals of bytes
+//! written and read double as the ring's tail and head indices, and each side publishes its
+//! index with release ordering and observes the other's with acquire ordering.
+//!
+//! Unlike ByteStream, this class never adopts caller buffers: every byte is copied into the
+//! ring, so that the reader only ever has to follow a single index.
+//!
+//! Either side can also block: read_wait() parks the reader until there is something to read,
+//! and write_wait() parks the writer until there is room. Each side parks on an
+//! [eventfd(2)](\ref man2::eventfd), read_event() or write_event(), which the other side
+//! signals only if the waiter has armed it. The same descriptors can be handed to
+//! EventLoop::add_rule, so that a stream filling up or draining wakes an event loop directly.
+//! Once the stream reaches eof(), read_event() is signaled every time it is armed, so the rule
+//! must then stop rearming it and lose interest:
+//!
+//! ~~~{.cc}
+//! stream.arm_read_event();
+//! loop.add_rule(
+//!     stream.read_event(),
+//!     Direction::In,
+//!     [&] {
+//!         stream.clear_read_event();
+//!         consume(stream.read(stream.buffer_size()));
+//!         if (not stream.eof() and not stream.error()) {
+//!             stream.arm_read_event();
+//!         }
+//!     },
+//!     [&] { return not stream.eof() and not stream.error(); });
+//! ~~~
+//!
+//! \note Only one thread may call the "input" methods and only one thread may call the
+//! "output" methods. The accounting methods may be called from either side, but the
+//! result is only a snapshot when called from the other one.
+class ConcurrentByteStream {
+  private:
+    //! Size of a cache line, used to keep the reader's and writer's indices apart
+    static constexpr size_t CACHE_LINE = 64;
+
+    std::string _ring;  //!< Backing storage, a power of two no smaller than the capacity
+    size_t _mask;       //!< `_ring.size() - 1`, maps a stream index to a position in `_ring`
+    size_t _capacity;   //!< Maximum number of bytes held in the stream at once
+
+    alignas(CACHE_LINE) std::atomic<size_t> _bytes_written{0};  //!< Tail index, advanced by the writer
+    alignas(CACHE_LINE) std::atomic<size_t> _bytes_read{0};     //!< Head index, advanced by the reader
+    alignas(CACHE_LINE) std::atomic<bool> _input_ended{false};  //!< Flag indicating that the input has ended
+    std::atomic<bool> _error{false};                            //!< Flag indicating that the stream suffered an error
+
+    FileDescriptor _read_event;                   //!< eventfd signaled for a reader that armed it
+    FileDescriptor _write_event;                  //!< eventfd signaled for a writer that armed it
+    std::atomic<bool> _read_event_armed{false};   //!< The reader is waiting on `_read_event`
+    std::atomic<bool> _write_event_armed{false};  //!< The writer is waiting on `_write_event`
+
+    //! Signal `event` if `armed` was set, clearing `armed`
+    void signal_event(std::atomic<bool> &armed, FileDescriptor &event);
+
+  public:
+    //! Construct a stream with room for `capacity` bytes.
+    ConcurrentByteStream(const size_t capacity);
+
+    //! \name "Input" interface for the writer thread
+    //!@{
+
+    //! Write a string of bytes into the stream. Write as many
+    //! as will fit, and return how many were written.
+    //! \returns the number of bytes accepted into the stream
+    size_t write(const std::string &data) { return write(std::string_view(data)); }
+
+    //! Write a string of bytes into the stream. Write as many
+    //! as will fit, and return how many were written.
+    //! \returns the number of bytes accepted into the stream
+    size_t write(const std::string_view data);
+
+    //! \returns the number of additional bytes that the stream has space for
+    size_t remaining_capacity() const;
+
+    //! Write all of `data`, waiting for room as needed, for at most `timeout_ms` milliseconds
+    //! \returns the number of bytes accepted into the stream
+    size_t write_wait(const std::string_view data, const int timeout_ms = -1);
+
+    //! Signal that the byte stream has reached its ending
+    void end_input();
+
+    //! Indicate that the stream suffered an error.
+    void set_error();
+    //!@}
+
+    //! \name "Output" interface for the reader thread
+    //!@{
+
+    //! Peek at next "len" bytes of the stream
+    //! \returns a string
+    std::string peek_output(const size_t len) const;
+
+    //! Peek at next "len" bytes of the stream without copying them
+    //! \returns up to two views into the stream's storage
+    //! \note The views stay valid until the reader next calls pop_output() or read()
+    BufferViewList peek_views(const size_t len) const;
+
+    //! Remove bytes from the buffer
+    void pop_output(const size_t len);
+
+    //! Read (i.e., copy and then pop) the next "len" bytes of the stream
+    //! \returns a string
+    std::string read(const size_t len);
+
+    //! Wait for at most `timeout_ms` milliseconds until the stream is readable, then read up to "len" bytes
+    //! \returns a string, which is empty if the wait timed out or the stream reached eof()
+    std::string read_wait(const size_t len, const int timeout_ms = -1);
+
+    //! \returns `true` if the stream input has ended
+    bool input_ended() const { return _input_ended.load(std::memory_order_acquire); }
+
+    //! \returns `true` if the stream has suffered an error
+    bool error() const { return _error.load(std::memory_order_acquire); }
+
+    //! \returns the maximum amount that can currently be read from the stream
+    size_t buffer_size() const;
+
+    //! \returns `true` if the buffer is empty
+    bool buffer_empty() const { return buffer_size() == 0; }
+
+    //! \returns `true` if the output has reached the ending
+    bool eof() const;
+    //!@}
+
+    //! \name General accounting
+    //!@{
+
+    //! Total number of bytes written
+    size_t bytes_written() const { return _bytes_written.load(std::memory_order_acquire); }
+
+    //! Total number of bytes popped
+    size_t bytes_read() const { return _bytes_read.load(std::memory_order_acquire); }
+    //!@}
+
+    //! \name Wakeup events, for use with EventLoop
+    //!@{
+
+    //! eventfd that becomes readable after arm_read_event() once there is data, eof, or an error
+    const FileDescriptor &read_event() const { return _read_event; }
+
+    //! eventfd that becomes readable after arm_write_event() once there is room, or an error
+    const FileDescriptor &write_event() const { return _write_event; }
+
+    //! Ask the writer to signal read_event() (signals it right away if the stream is already readable)
+    void arm_read_event();
+
+    //! Ask the reader to signal write_event() (signals it right away if the stream already has room)
+    void arm_write_event();
+
+    //! Consume a signal on read_event(); call only when it is readable
+    void clear_read_event() { _read_event.read(sizeof(uint64_t)); }
+
+    //! Consume a signal on write_event(); call only when it is readable
+    void clear_write_event() { _write_event.read(sizeof(uint64_t)); }
+    //!@}
+};
+
+#endif  // SPONGE_LIBSPONGE_CONCURRENT_BYTE_STREAM_HH
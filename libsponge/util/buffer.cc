@@ -1,5 +1,9 @@
 #include "buffer.hh"
 
+#include <cstring>
+#include <new>
+#include <type_traits>
+
 using namespace std;
 
 void Buffer::remove_prefix(const size_t n) {
@@ -7,14 +11,163 @@ void Buffer::remove_prefix(const size_t n) {
         throw out_of_range("Buffer::remove_prefix");
     }
     _starting_offset += n;
-    if (_storage and _starting_offset == _storage->size()) {
+    if (_storage and _starting_offset == _ending_offset) {
+        _storage.reset();
+    }
+}
+
+void Buffer::remove_suffix(const size_t n) {
+    if (n > str().size()) {
+        throw out_of_range("Buffer::remove_suffix");
+    }
+    _ending_offset -= n;
+    if (_storage and _starting_offset == _ending_offset) {
         _storage.reset();
     }
 }
 
+//! \param[in] block is a block that has just been filled
+//! \param[in] size is the number of bytes at the start of `block` that were filled
+//! \details This keeps a few bytes from pinning a large block, which then goes straight back to the pool.
+Buffer Buffer::fitted(BufferPool::Block block, const size_t size) {
+    if (BufferPool::block_size(size) < block.capacity()) {
+        BufferPool::Block fitted = BufferPool::acquire(size);
+        memcpy(fitted.data(), block.data(), size);
+        block = move(fitted);
+    }
+    return Buffer(move(block), size);
+}
+
+namespace {
+//! Set once this thread's free lists have been destroyed, after which released blocks are just freed
+thread_local bool free_slabs_destroyed = false;
+
+//! \returns the index of the smallest size class that holds `size` bytes, or SIZE_CLASSES if none does
+size_t size_class_of(const size_t size) {
+    const auto &sizes = BufferPool::CLASS_SIZES;
+    return lower_bound(sizes.begin(), sizes.end(), size) - sizes.begin();
+}
+
+//! \returns this thread's counts for each size class
+array<BufferPool::Stats, BufferPool::SIZE_CLASSES> &thread_stats() {
+    thread_local array<BufferPool::Stats, BufferPool::SIZE_CLASSES> ret{};
+    return ret;
+}
+}  // namespace
+
+//! The header of a block made from a std::string, which holds the string (and so its bytes)
+struct BufferPool::AdoptedSlab : public Slab {
+    string str;  //!< The adopted string
+
+    explicit AdoptedSlab(string &&str_) : Slab(str_.size(), ADOPTED), str(move(str_)) { bytes = str.data(); }
+};
+
+//! The released slabs kept by one thread, one free list per size class
+struct BufferPool::FreeSlabs {
+    array<vector<Slab *>, SIZE_CLASSES> lists{};
+
+    // reserved up front, so that returning a block to the pool never allocates
+    FreeSlabs() {
+        for (auto &list : lists) {
+            list.reserve(MAX_FREE_BLOCKS);
+        }
+    }
+
+    ~FreeSlabs() {
+        free_slabs_destroyed = true;
+        for (auto &list : lists) {
+            for (Slab *slab : list) {
+                destroy(slab);
+            }
+        }
+    }
+
+    FreeSlabs(const FreeSlabs &other) = delete;
+    FreeSlabs &operator=(const FreeSlabs &other) = delete;
+};
+
+BufferPool::FreeSlabs &BufferPool::free_slabs() {
+    thread_local FreeSlabs ret;
+    return ret;
+}
+
+//! \param[in] capacity is the number of bytes to allocate after the header
+//! \param[in] size_class is the slab's index into CLASS_SIZES, or SIZE_CLASSES
+//! \returns a slab with one reference
+BufferPool::Slab *BufferPool::allocate(const size_t capacity, const size_t size_class) {
+    void *const memory = ::operator new(sizeof(Slab) + capacity);
+    return new (memory) Slab(capacity, size_class);
+}
+
+void BufferPool::destroy(Slab *slab) {
+    if (slab->size_class == ADOPTED) {
+        delete static_cast<AdoptedSlab *>(slab);
+        return;
+    }
+    static_assert(is_trivially_destructible_v<Slab>, "pooled slabs are freed without being destroyed");
+    ::operator delete(slab);
+}
+
+//! \param[in] slab has just lost its last reference
+void BufferPool::recycle(Slab *slab) {
+    if (slab->size_class < SIZE_CLASSES and not free_slabs_destroyed) {
+        auto &list = free_slabs().lists[slab->size_class];
+        Stats &stats = thread_stats()[slab->size_class];
+        if (list.size() < MAX_FREE_BLOCKS) {
+            ++stats.recycled;
+            list.push_back(slab);
+            return;
+        }
+        ++stats.discarded;
+    }
+    destroy(slab);
+}
+
+//! \param[in] size is the number of bytes needed
+BufferPool::Block BufferPool::acquire(const size_t size) {
+    const size_t size_class = size_class_of(size);
+    if (size_class == SIZE_CLASSES) {
+        return Block(allocate(size, SIZE_CLASSES));
+    }
+
+    Stats &stats = thread_stats()[size_class];
+    if (not free_slabs_destroyed) {
+        auto &list = free_slabs().lists[size_class];
+        if (not list.empty()) {
+            ++stats.hits;
+            Slab *const slab = list.back();
+            list.pop_back();
+            slab->refs.reset();
+            return Block(slab);
+        }
+    }
+    ++stats.misses;
+    return Block(allocate(CLASS_SIZES[size_class], size_class));
+}
+
+//! \param[in] size is a number of bytes, as would be passed to acquire()
+size_t BufferPool::block_size(const size_t size) {
+    const size_t size_class = size_class_of(size);
+    return size_class == SIZE_CLASSES ? size : CLASS_SIZES[size_class];
+}
+
+//! \param[in] size is a number of bytes, as would be passed to acquire(); at most BLOCK_SIZE
+//! \details Blocks are counted by the thread that acquires or releases them, so a block
+//! released by another thread counts toward that thread's free list, not this one's.
+BufferPool::Stats BufferPool::stats(const size_t size) {
+    const size_t size_class = size_class_of(size);
+    if (size_class == SIZE_CLASSES) {
+        throw out_of_range("BufferPool::stats: blocks of that size are not pooled");
+    }
+    return thread_stats()[size_class];
+}
+
+//! \param[in] str is the string whose storage the block takes over
+BufferPool::Block BufferPool::Block::adopt(string &&str) { return Block(new AdoptedSlab(move(str))); }
+
 void BufferList::append(const BufferList &other) {
     for (const auto &buf : other._buffers) {
-        _buffers.push_back(buf);
+        append(buf);
     }
 }
 
@@ -40,42 +193,88 @@ string BufferList::concatenate() const {
     return ret;
 }
 
-size_t BufferList::size() const {
-    size_t ret = 0;
-    for (const auto &buf : _buffers) {
-        ret += buf.size();
+void BufferList::remove_prefix(size_t n) {
+    if (n > _size) {
+        throw std::out_of_range("BufferList::remove_prefix");
     }
-    return ret;
-}
+    _size -= n;
+    _origin += n;
 
-void BufferList::remove_prefix(size_t n) {
     while (n > 0) {
-        if (_buffers.empty()) {
-            throw std::out_of_range("BufferList::remove_prefix");
-        }
-
         if (n < _buffers.front().str().size()) {
             _buffers.front().remove_prefix(n);
             n = 0;
         } else {
             n -= _buffers.front().str().size();
             _buffers.pop_front();
+            _ends.pop_front();
         }
     }
 }
 
-BufferViewList::BufferViewList(const BufferList &buffers) {
+//! \param[in] n is a location in the list, less than size()
+//! \details The Buffer that holds the byte is the first one that ends after it (skipping empty Buffers).
+size_t BufferList::find(const size_t n) const {
+    return upper_bound(_ends.begin(), _ends.end(), _origin + n) - _ends.begin();
+}
+
+//! \param[in] n is the location of the character, less than size()
+uint8_t BufferList::at(const size_t n) const {
+    if (n >= _size) {
+        throw out_of_range("BufferList::at");
+    }
+    const size_t index = find(n);
+    return _buffers[index].at(_origin + n - start_of(index));
+}
+
+//! \param[in] offset is the location of the first byte of the slice
+//! \param[in] len is the number of bytes in the slice; `offset + len` must not exceed size()
+//! \returns a BufferList of copies of the Buffers that overlap the range, trimmed to it
+BufferList BufferList::slice(const size_t offset, const size_t len) const {
+    if (offset > _size or len > _size - offset) {
+        throw out_of_range("BufferList::slice");
+    }
+
+    BufferList ret{};
+    if (len == 0) {
+        return ret;
+    }
+
+    const size_t first = find(offset), last = find(offset + len - 1);
+    for (size_t index = first; index <= last; ++index) {
+        Buffer buffer = _buffers[index];
+        const size_t start = start_of(index);
+        if (index == last) {
+            buffer.remove_suffix(_ends[index] - (_origin + offset + len));
+        }
+        if (index == first) {
+            buffer.remove_prefix(_origin + offset - start);
+        }
+        ret.append(std::move(buffer));
+    }
+    return ret;
+}
+
+BufferViewList::BufferViewList(const BufferList &buffers) : _views(), _size(buffers.size()) {
     for (const auto &x : buffers.buffers()) {
         _views.push_back(x);
     }
 }
 
+void BufferViewList::append(std::string_view str) {
+    if (not str.empty()) {
+        _views.push_back(str);
+        _size += str.size();
+    }
+}
+
 void BufferViewList::remove_prefix(size_t n) {
-    while (n > 0) {
-        if (_views.empty()) {
-            throw std::out_of_range("BufferListView::remove_prefix");
-        }
+    if (n > _size) {
+        throw std::out_of_range("BufferListView::remove_prefix");
+    }
+    _size -= n;
 
+    while (n > 0) {
         if (n < _views.front().size()) {
             _views.front().remove_prefix(n);
             n = 0;
@@ -86,14 +285,6 @@ void BufferViewList::remove_prefix(size_t n) {
     }
 }
 
-size_t BufferViewList::size() const {
-    size_t ret = 0;
-    for (const auto &buf : _views) {
-        ret += buf.size();
-    }
-    return ret;
-}
-
 vector<iovec> BufferViewList::as_iovecs() const {
     vector<iovec> ret;
     ret.reserve(_views.size());
@@ -102,3 +293,59 @@ vector<iovec> BufferViewList::as_iovecs() const {
     }
     return ret;
 }
+
+//! \param[in] views are the bytes to write
+//! \param[in] storage is an array for the cursor to fill; it must outlive the cursor
+//! \param[in] capacity is the number of entries in `storage` (at least 1)
+IovecCursor::IovecCursor(const BufferViewList &views, iovec *storage, const size_t capacity)
+    : _next(views.views().begin())
+    , _end(views.views().end())
+    , _storage(storage)
+    , _capacity(capacity)
+    , _remaining(views.size()) {
+    if (capacity == 0) {
+        throw invalid_argument("IovecCursor: no storage");
+    }
+    refill();
+}
+
+void IovecCursor::refill() {
+    if (_first > 0) {
+        memmove(_storage, _storage + _first, (_last - _first) * sizeof(iovec));
+        _last -= _first;
+        _first = 0;
+    }
+    for (; _last < _capacity and _next != _end; ++_next) {
+        if (not _next->empty()) {
+            _storage[_last++] = {const_cast<char *>(_next->data()), _next->size()};
+        }
+    }
+}
+
+//! \param[in] n is the number of bytes written, e.g. as returned by [writev(2)](\ref man2::writev)
+void IovecCursor::advance(size_t n) {
+    if (n > _remaining) {
+        throw out_of_range("IovecCursor::advance");
+    }
+    _remaining -= n;
+
+    while (n > 0) {
+        if (_first == _last) {
+            refill();  // only if the caller wrote more than the array held
+        }
+        iovec &entry = _storage[_first];
+        if (n < entry.iov_len) {
+            entry.iov_base = static_cast<char *>(entry.iov_base) + n;
+            entry.iov_len -= n;
+            break;
+        }
+        n -= entry.iov_len;
+        ++_first;
+    }
+
+    // top up the array only when it has been at least half written (or when it has run dry),
+    // so that a run of short writes doesn't move the same entries over and over
+    if (_next != _end and (_first == _last or _first >= _capacity / 2)) {
+        refill();
+    }
+}
@@ -2,26 +2,221 @@
 #define SPONGE_LIBSPONGE_BUFFER_HH
 
 #include <algorithm>
-#include <deque>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
 #include <memory>
 #include <numeric>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <sys/uio.h>
+#include <thread>
+#include <utility>
 #include <vector>
 
+//! \brief A reference count that may be shared across threads
+class AtomicRefCount {
+    std::atomic<size_t> _count{1};  //!< Number of references
+
+  public:
+    //! Add a reference
+    void increment() { _count.fetch_add(1, std::memory_order_relaxed); }
+
+    //! Drop a reference, and return `true` if it was the last one
+    bool decrement() { return _count.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+    //! Start over with one reference
+    void reset() { _count.store(1, std::memory_order_relaxed); }
+};
+
+//! \brief A plain (non-atomic) reference count, for storage that never leaves one thread
+//! \details Saves the locked instructions of AtomicRefCount, so it is only safe while every copy
+//! and release happens on the thread that created (or last reset) the count, e.g. an EventLoop's
+//! thread. In debug builds (without `NDEBUG`), each operation asserts that this is so.
+class LocalRefCount {
+    size_t _count = 1;  //!< Number of references
+#ifndef NDEBUG
+    std::thread::id _owner = std::this_thread::get_id();  //!< The only thread that may use the count
+#endif
+
+    //! Check that the calling thread owns the count (in debug builds)
+    void check_owner() const {
+#ifndef NDEBUG
+        assert(std::this_thread::get_id() == _owner and "LocalRefCount used from a second thread");
+#endif
+    }
+
+  public:
+    //! Add a reference
+    void increment() {
+        check_owner();
+        ++_count;
+    }
+
+    //! Drop a reference, and return `true` if it was the last one
+    bool decrement() {
+        check_owner();
+        return --_count == 0;
+    }
+
+    //! Start over with one reference, owned by the calling thread
+    void reset() {
+        _count = 1;
+#ifndef NDEBUG
+        _owner = std::this_thread::get_id();
+#endif
+    }
+};
+
+//! The reference count of Buffer storage: LocalRefCount if built with the `SPONGE_LOCAL_REFCOUNT`
+//! option (for programs whose Buffers stay on the thread that made them), otherwise AtomicRefCount
+#ifdef SPONGE_LOCAL_REFCOUNT
+using BufferRefCount = LocalRefCount;
+#else
+using BufferRefCount = AtomicRefCount;
+#endif
+
+//! \brief A per-thread pool of recycled blocks of storage for Buffer, in a few size classes
+//! \details A block is a slab: a header holding the block's reference count, followed in the
+//! same allocation by the block's bytes. Blocks come in CLASS_SIZES; a request is served by the
+//! smallest class that fits it, so a short payload doesn't pin a large block. Blocks are
+//! allocated only the first time; afterwards a released block is kept by the thread that
+//! released it, on that class's free list, and handed out again as is. Requests larger than
+//! BLOCK_SIZE get a block of their own, which is freed rather than pooled. So does a block made
+//! from a std::string (see Block::adopt), whose header is followed by the string instead of bytes.
+class BufferPool {
+  public:
+    static constexpr size_t SIZE_CLASSES = 3;  //!< Number of sizes of pooled blocks
+    static constexpr std::array<size_t, SIZE_CLASSES> CLASS_SIZES{2 * 1024, 16 * 1024, 64 * 1024};  //!< Ascending
+    static constexpr size_t BLOCK_SIZE = CLASS_SIZES.back();  //!< Size of the largest pooled blocks
+    static constexpr size_t MAX_FREE_BLOCKS = 32;              //!< Released blocks of each size kept by each thread
+
+    //! \brief Counts of one thread's use of one size class
+    struct Stats {
+        uint64_t hits = 0;       //!< Blocks handed out from the free list
+        uint64_t misses = 0;     //!< Blocks that had to be allocated
+        uint64_t recycled = 0;   //!< Released blocks kept on the free list
+        uint64_t discarded = 0;  //!< Released blocks freed because the free list was full
+    };
+
+    class Block;
+
+  private:
+    //! The Slab::size_class of a block made from a std::string (see AdoptedSlab)
+    static constexpr size_t ADOPTED = SIZE_CLASSES + 1;
+
+    //! \brief The header of a block
+    struct Slab {
+        BufferRefCount refs{};  //!< Number of Block objects that refer to the slab
+        size_t capacity;        //!< Number of bytes in the block
+        size_t size_class;      //!< Index into CLASS_SIZES, SIZE_CLASSES if the block is not pooled, or ADOPTED
+        char *bytes;            //!< The block's bytes (just past the header, unless adopted)
+
+        Slab(const size_t capacity_, const size_t size_class_)
+            : capacity(capacity_), size_class(size_class_), bytes(reinterpret_cast<char *>(this + 1)) {}
+
+        Slab(const Slab &other) = delete;
+        Slab &operator=(const Slab &other) = delete;
+    };
+
+    struct AdoptedSlab;
+    struct FreeSlabs;
+
+    //! This thread's released slabs
+    static FreeSlabs &free_slabs();
+
+    //! Allocate a slab with room for `capacity` bytes
+    static Slab *allocate(const size_t capacity, const size_t size_class);
+
+    //! Free a slab
+    static void destroy(Slab *slab);
+
+    //! Keep a slab that is no longer referenced for reuse, or free it
+    static void recycle(Slab *slab);
+
+  public:
+    //! \brief Get a block of at least `size` bytes with unspecified contents
+    //! \note The block goes back to the pool when the last reference to it is released.
+    static Block acquire(const size_t size = BLOCK_SIZE);
+
+    //! \brief The capacity of the block that acquire() would return for `size` bytes
+    static size_t block_size(const size_t size);
+
+    //! \brief The calling thread's counts for the size class that serves `size` bytes
+    static Stats stats(const size_t size = BLOCK_SIZE);
+};
+
+//! \brief A counted reference to a block of storage from the BufferPool
+//! \details The count, a BufferRefCount, lives in the block itself, so sharing a block costs no allocation.
+class BufferPool::Block {
+    Slab *_slab = nullptr;  //!< The referenced block, if any
+
+    explicit Block(Slab *slab) : _slab(slab) {}
+    friend class BufferPool;
+
+  public:
+    Block() = default;
+
+    //! \brief Take over the storage of a std::string, as a block that is freed (not pooled) once released
+    static Block adopt(std::string &&str);
+
+    //! \name Copy/move constructor/assignment operators
+    //! Copies share the block; a moved-from Block is empty
+    //!@{
+    Block(const Block &other) noexcept : _slab(other._slab) {
+        if (_slab) {
+            _slab->refs.increment();
+        }
+    }
+    Block(Block &&other) noexcept : _slab(std::exchange(other._slab, nullptr)) {}
+    Block &operator=(Block other) noexcept {
+        std::swap(_slab, other._slab);
+        return *this;
+    }
+    //!@}
+
+    ~Block() { reset(); }
+
+    //! \brief Drop the reference (recycling the block if it was the last one)
+    void reset() {
+        if (_slab and _slab->refs.decrement()) {
+            recycle(_slab);
+        }
+        _slab = nullptr;
+    }
+
+    //! \brief The block's bytes
+    char *data() const { return _slab->bytes; }
+
+    //! \brief Number of bytes in the block
+    size_t capacity() const { return _slab->capacity; }
+
+    //! \returns `true` if the Block refers to a block
+    explicit operator bool() const { return _slab != nullptr; }
+};
+
 //! \brief A reference-counted read-only string that can discard bytes from the front
 class Buffer {
   private:
-    std::shared_ptr<std::string> _storage{};
+    BufferPool::Block _storage{};
     size_t _starting_offset{};
+    size_t _ending_offset{};
 
   public:
     Buffer() = default;
 
     //! \brief Construct by taking ownership of a string
-    Buffer(std::string &&str) noexcept : _storage(std::make_shared<std::string>(std::move(str))) {}
+    Buffer(std::string &&str) noexcept
+        : _storage(BufferPool::Block::adopt(std::move(str))), _ending_offset(_storage.capacity()) {}
+
+    //! \brief Construct by sharing a block, of which only the first `size` bytes are used
+    Buffer(BufferPool::Block storage, const size_t size) : _storage(std::move(storage)), _ending_offset(size) {}
+
+    //! \brief Construct from the first `size` bytes of a pooled block, copied into a smaller block if they fit in one
+    static Buffer fitted(BufferPool::Block block, const size_t size);
 
     //! \name Expose contents as a std::string_view
     //!@{
@@ -29,7 +224,7 @@ class Buffer {
         if (not _storage) {
             return {};
         }
-        return {_storage->data() + _starting_offset, _storage->size() - _starting_offset};
+        return {_storage.data() + _starting_offset, _ending_offset - _starting_offset};
     }
 
     operator std::string_view() const { return str(); }
@@ -47,6 +242,101 @@ class Buffer {
     //! \brief Discard the first `n` bytes of the string (does not require a copy or move)
     //! \note Doesn't free any memory until the whole string has been discarded in all copies of the Buffer.
     void remove_prefix(const size_t n);
+
+    //! \brief Discard the last `n` bytes of the string (does not require a copy or move)
+    //! \note Doesn't free any memory until the whole string has been discarded in all copies of the Buffer.
+    void remove_suffix(const size_t n);
+};
+
+//! \brief A queue that keeps up to `N` elements inline, and moves them to the heap only if it outgrows that
+//! \details Elements are added at the back and removed from the front, and are always contiguous,
+//! so they can be iterated with pointers. Once the queue has spilled to the heap, it stays there
+//! (keeping the capacity it has grown), and removed elements are compacted away lazily, so both
+//! operations take amortized constant time.
+template <typename T, size_t N>
+class InlineQueue {
+    std::array<T, N> _inline{};  //!< Storage for the elements, until there are more than N
+    std::vector<T> _heap{};      //!< Storage for the elements, once there have been more than N
+    size_t _head = 0;            //!< Index of the front element in the storage in use
+    size_t _tail = 0;            //!< Index one past the back element in the storage in use
+    bool _spilled = false;       //!< Whether the elements are in `_heap`
+
+    T *storage() { return _spilled ? _heap.data() : _inline.data(); }
+    const T *storage() const { return _spilled ? _heap.data() : _inline.data(); }
+
+  public:
+    InlineQueue() = default;
+
+    //! \name Copy/move constructor/assignment operators
+    //! A moved-from InlineQueue is empty
+    //!@{
+    InlineQueue(const InlineQueue &other) = default;
+    InlineQueue &operator=(const InlineQueue &other) = default;
+    InlineQueue(InlineQueue &&other) noexcept
+        : _inline(std::move(other._inline))
+        , _heap(std::move(other._heap))
+        , _head(std::exchange(other._head, 0))
+        , _tail(std::exchange(other._tail, 0))
+        , _spilled(std::exchange(other._spilled, false)) {}
+    InlineQueue &operator=(InlineQueue &&other) noexcept {
+        _inline = std::move(other._inline);
+        _heap = std::move(other._heap);
+        _head = std::exchange(other._head, 0);
+        _tail = std::exchange(other._tail, 0);
+        _spilled = std::exchange(other._spilled, false);
+        return *this;
+    }
+    //!@}
+
+    //! \name Element access
+    //!@{
+    size_t size() const { return _tail - _head; }
+    bool empty() const { return _head == _tail; }
+    T &front() { return storage()[_head]; }
+    const T &front() const { return storage()[_head]; }
+    const T &operator[](const size_t n) const { return storage()[_head + n]; }
+    T *begin() { return storage() + _head; }
+    T *end() { return storage() + _tail; }
+    const T *begin() const { return storage() + _head; }
+    const T *end() const { return storage() + _tail; }
+    //!@}
+
+    //! \brief Add an element at the back
+    void push_back(T value) {
+        if (not _spilled) {
+            if (_tail == N and _head > 0) {
+                // slide the elements down to make room
+                std::move(_inline.begin() + _head, _inline.begin() + _tail, _inline.begin());
+                _tail -= _head;
+                _head = 0;
+            }
+            if (_tail < N) {
+                _inline[_tail++] = std::move(value);
+                return;
+            }
+
+            // outgrown: move to the heap
+            _heap.reserve(2 * N);
+            std::move(_inline.begin(), _inline.end(), std::back_inserter(_heap));
+            _spilled = true;
+        } else if (_head > 0 and _head >= size()) {
+            // at least half of the heap storage holds removed elements
+            _heap.erase(_heap.begin(), _heap.begin() + _head);
+            _tail -= _head;
+            _head = 0;
+        }
+        _heap.push_back(std::move(value));
+        ++_tail;
+    }
+
+    //! \brief Remove the front element
+    void pop_front() {
+        storage()[_head++] = T{};  // release whatever the element holds now, rather than when it is overwritten
+        if (_head == _tail) {
+            _heap.clear();
+            _head = _tail = 0;
+        }
+    }
 };
 
 //! \brief A reference-counted discontiguous string that can discard bytes from the front
@@ -54,9 +344,26 @@ class Buffer {
 //! + a payload. This allows us to prepend headers (e.g., to
 //! encapsulate a TCP payload in a TCPSegment, and then encapsulate
 //! the TCPSegment in an IPv4Datagram) without copying the payload.
+//! \details Like a rope, the list keeps an index of where each Buffer ends (a prefix sum of their
+//! sizes), so a byte or a range in the middle of a many-fragment payload is found with a binary
+//! search, and slice() cuts out a range that shares the Buffers' storage. The ends are counted
+//! from the first byte ever in the list, so discarding bytes from the front doesn't renumber them.
 class BufferList {
+  public:
+    static constexpr size_t INLINE_BUFFERS = 4;        //!< Number of Buffers held without a heap allocation
+    using QueueT = InlineQueue<Buffer, INLINE_BUFFERS>;  //!< The queue of Buffers
+
   private:
-    std::deque<Buffer> _buffers{};
+    QueueT _buffers{};                            //!< The Buffers, in order
+    InlineQueue<size_t, INLINE_BUFFERS> _ends{};  //!< Position one past each Buffer's last byte
+    size_t _origin = 0;                           //!< Position of the first byte (bytes discarded so far)
+    size_t _size = 0;                             //!< Total size of the Buffers
+
+    //! Index of the Buffer that holds byte `n`, which must be in the list
+    size_t find(const size_t n) const;
+
+    //! Position of the first byte of Buffer `index`
+    size_t start_of(const size_t index) const { return index == 0 ? _origin : _ends[index - 1]; }
 
   public:
     //! \name Constructors
@@ -65,17 +372,40 @@ class BufferList {
     BufferList() = default;
 
     //! \brief Construct from a Buffer
-    BufferList(Buffer buffer) : _buffers{buffer} {}
+    BufferList(Buffer buffer) : _buffers(), _ends(), _size(0) { append(std::move(buffer)); }
 
     //! \brief Construct by taking ownership of a std::string
-    BufferList(std::string &&str) noexcept {
-        Buffer buf{std::move(str)};
-        append(buf);
+    BufferList(std::string &&str) noexcept : BufferList(Buffer(std::move(str))) {}
+    //!@}
+
+    //! \name Copy/move constructor/assignment operators
+    //! A moved-from BufferList is empty
+    //!@{
+    BufferList(const BufferList &other) = default;
+    BufferList &operator=(const BufferList &other) = default;
+    BufferList(BufferList &&other) noexcept
+        : _buffers(std::move(other._buffers))
+        , _ends(std::move(other._ends))
+        , _origin(std::exchange(other._origin, 0))
+        , _size(std::exchange(other._size, 0)) {}
+    BufferList &operator=(BufferList &&other) noexcept {
+        _buffers = std::move(other._buffers);
+        _ends = std::move(other._ends);
+        _origin = std::exchange(other._origin, 0);
+        _size = std::exchange(other._size, 0);
+        return *this;
     }
     //!@}
 
     //! \brief Access the underlying queue of Buffers
-    const std::deque<Buffer> &buffers() const { return _buffers; }
+    const QueueT &buffers() const { return _buffers; }
+
+    //! \brief Append a Buffer
+    void append(Buffer buffer) {
+        _ends.push_back(_origin + _size + buffer.size());
+        _size += buffer.size();
+        _buffers.push_back(std::move(buffer));
+    }
 
     //! \brief Append a BufferList
     void append(const BufferList &other);
@@ -87,8 +417,14 @@ class BufferList {
     //! \brief Discard the first `n` bytes of the string (does not require a copy or move)
     void remove_prefix(size_t n);
 
+    //! \brief Get character at location `n`, in time logarithmic in the number of Buffers
+    uint8_t at(const size_t n) const;
+
+    //! \brief The `len` bytes starting at location `offset`, sharing the storage of this list's Buffers
+    BufferList slice(const size_t offset, const size_t len) const;
+
     //! \brief Size of the string
-    size_t size() const;
+    size_t size() const { return _size; }
 
     //! \brief Make a copy to a new std::string
     std::string concatenate() const;
@@ -96,12 +432,20 @@ class BufferList {
 
 //! \brief A non-owning temporary view (similar to std::string_view) of a discontiguous string
 class BufferViewList {
-    std::deque<std::string_view> _views{};
+  public:
+    static constexpr size_t INLINE_VIEWS = 4;                   //!< Number of views held without a heap allocation
+    using QueueT = InlineQueue<std::string_view, INLINE_VIEWS>;  //!< The queue of views
+
+  private:
+    QueueT _views{};   //!< The views, in order
+    size_t _size = 0;  //!< Total size of the views
 
   public:
     //! \name Constructors
     //!@{
 
+    BufferViewList() = default;
+
     //! \brief Construct from a std::string
     BufferViewList(const std::string &str) : BufferViewList(std::string_view(str)) {}
 
@@ -112,14 +456,34 @@ class BufferViewList {
     BufferViewList(const BufferList &buffers);
 
     //! \brief Construct from a std::string_view
-    BufferViewList(std::string_view str) { _views.push_back({const_cast<char *>(str.data()), str.size()}); }
+    BufferViewList(std::string_view str) : _views(), _size(str.size()) { _views.push_back(str); }
     //!@}
 
+    //! \name Copy/move constructor/assignment operators
+    //! A moved-from BufferViewList is empty
+    //!@{
+    BufferViewList(const BufferViewList &other) = default;
+    BufferViewList &operator=(const BufferViewList &other) = default;
+    BufferViewList(BufferViewList &&other) noexcept
+        : _views(std::move(other._views)), _size(std::exchange(other._size, 0)) {}
+    BufferViewList &operator=(BufferViewList &&other) noexcept {
+        _views = std::move(other._views);
+        _size = std::exchange(other._size, 0);
+        return *this;
+    }
+    //!@}
+
+    //! \brief Access the underlying queue of views
+    const QueueT &views() const { return _views; }
+
+    //! \brief Append a view to the end of the list (empty views are ignored)
+    void append(std::string_view str);
+
     //! \brief Discard the first `n` bytes of the string (does not require a copy or move)
     void remove_prefix(size_t n);
 
     //! \brief Size of the string
-    size_t size() const;
+    size_t size() const { return _size; }
 
     //! \brief Convert to a vector of `iovec` structures
     //! \note used for system calls that write discontiguous buffers,
@@ -127,4 +491,60 @@ class BufferViewList {
     std::vector<iovec> as_iovecs() const;
 };
 
+//! \brief Walks a BufferViewList as `iovec` structures in caller-provided storage, for repeated scatter writes
+//! \details The cursor fills a fixed array (e.g., of [IOV_MAX](\ref man2::writev) entries) with the
+//! first views, and after each (possibly short) write, advance() steps past the bytes written in
+//! place: whole entries are dropped, a partly written one is trimmed, and the array is topped up
+//! from the views that did not fit. No step allocates. The BufferViewList must stay unchanged, and
+//! alive, for as long as the cursor is in use.
+//!
+//! ~~~{.cc}
+//! std::array<iovec, IOV_MAX> storage;
+//! IovecCursor cursor{buffers, storage.data(), storage.size()};
+//! while (not cursor.done()) {
+//!     cursor.advance(SystemCall("writev", ::writev(fd, cursor.iovecs(), cursor.count())));
+//! }
+//! ~~~
+class IovecCursor {
+    const std::string_view *_next;  //!< The first view that is not yet in the array
+    const std::string_view *_end;   //!< One past the last view
+    iovec *_storage;                //!< The caller's array
+    size_t _capacity;               //!< Number of entries in `_storage`
+    size_t _first = 0;              //!< Index of the first entry with bytes left to write
+    size_t _last = 0;               //!< Index one past the last filled entry
+    size_t _remaining;              //!< Bytes left to write
+
+    //! Move the unwritten entries to the front of the array, and fill the rest of it with views
+    void refill();
+
+  public:
+    //! Start at the beginning of `views`, using the `capacity` entries of `storage`
+    IovecCursor(const BufferViewList &views, iovec *storage, const size_t capacity);
+
+    //! The entries to pass to the next write
+    const iovec *iovecs() const { return _storage + _first; }
+
+    //! Number of entries to pass to the next write
+    int count() const { return static_cast<int>(_last - _first); }
+
+    //! Bytes left to write
+    size_t remaining() const { return _remaining; }
+
+    //! \returns `true` if every byte has been written
+    bool done() const { return _remaining == 0; }
+
+    //! Step past `n` bytes that have been written
+    void advance(size_t n);
+
+    //! \name
+    //! An IovecCursor points into its storage, so it cannot be copied or moved
+
+    //!@{
+    IovecCursor(const IovecCursor &other) = delete;
+    IovecCursor &operator=(const IovecCursor &other) = delete;
+    IovecCursor(IovecCursor &&other) = delete;
+    IovecCursor &operator=(IovecCursor &&other) = delete;
+    //!@}
+};
+
 #endif  // SPONGE_LIBSPONGE_BUFFER_HH
@@ -2,8 +2,12 @@
 
 #include "util.hh"
 
+#include <algorithm>
+#include <array>
 #include <cerrno>
+#include <limits>
 #include <stdexcept>
+#include <sys/epoll.h>
 #include <system_error>
 #include <utility>
 #include <vector>
@@ -11,11 +15,40 @@
 using namespace std;
 
 unsigned int EventLoop::Rule::service_count() const {
-    return direction == Direction::In ? fd.read_count() : fd.write_count();
+    return direction == Direction::Out ? fd.write_count() : fd.read_count();
+}
+
+//! The epoll events that correspond to a Direction
+static uint32_t epoll_events(const Direction direction) {
+    switch (direction) {
+        case Direction::In:
+            return EPOLLIN;
+        case Direction::Out:
+            return EPOLLOUT;
+        case Direction::Error:
+            return EPOLLERR;
+    }
+    return 0;
+}
+
+//! \param[in] backend selects between [poll(2)](\ref man2::poll), [epoll(7)](\ref man7::epoll)
+//!                    and [io_uring(7)](\ref man7::io_uring)
+EventLoop::EventLoop(const Backend backend) : _backend(backend), _now(timestamp_ms()), _timers(_now) {
+    if (_backend == Backend::EpollLevel or _backend == Backend::EpollEdge) {
+        _epoll.emplace(SystemCall("epoll_create1", ::epoll_create1(EPOLL_CLOEXEC)));
+    } else if (_backend == Backend::IoUring) {
+        try {
+            _ring = make_unique<IOUring>();
+        } catch (const exception &) {
+            // e.g., an older kernel, or io_uring disabled by seccomp or sysctl
+            _backend = Backend::Poll;
+        }
+    }
 }
 
 //! \param[in] fd is the FileDescriptor to be polled
-//! \param[in] direction indicates whether to poll for reading (Direction::In) or writing (Direction::Out)
+//! \param[in] direction indicates whether to poll for reading (Direction::In), writing (Direction::Out)
+//!                      or errors (Direction::Error)
 //! \param[in] callback is called when `fd` is ready.
 //! \param[in] interest is called by EventLoop::wait_next_event. If it returns `true`, `fd` will
 //!                     be polled, otherwise `fd` will be ignored only for this execution of `wait_next_event.
@@ -25,7 +58,208 @@ void EventLoop::add_rule(const FileDescriptor &fd,
                          const CallbackT &callback,
                          const InterestT &interest,
                          const CallbackT &cancel) {
+    if (not _epoll.has_value()) {
+        _rules.push_back({fd.duplicate(), direction, callback, interest, cancel});
+        return;
+    }
+
+    // if this fd number belonged to an fd that has since been closed, its rules are stale
+    const int fd_num = fd.fd_num();
+    if (const auto stale = _registrations.find(fd_num); stale != _registrations.end()) {
+        const vector<RuleIterator> stale_rules = stale->second.rules;
+        if (not stale_rules.empty() and stale_rules.front()->fd.closed()) {
+            for (const auto rule : stale_rules) {
+                cancel_rule(rule);
+            }
+        }
+    }
+
+    // a new rule starts out parked, so the next wait_next_event asks whether it is interested
     _rules.push_back({fd.duplicate(), direction, callback, interest, cancel});
+    _rules.back().parked = true;
+    _registrations[fd_num].rules.push_back(prev(_rules.end()));
+    _parked.push_back(prev(_rules.end()));
+}
+
+//! \param[in] delay_ms is how long from now the timer should fire
+//! \param[in] callback is called (once) by wait_next_event when the timer fires
+//! \returns an id that can be passed to EventLoop::cancel_timer
+//! \details Called back from wait_next_event, this measures the delay from the clock reading that
+//! wait_next_event just took; otherwise, it reads the clock.
+EventLoop::TimerId EventLoop::add_timer(const uint64_t delay_ms, const CallbackT &callback) {
+    if (not _dispatching) {
+        _now = timestamp_ms();
+    }
+    return _timers.add(_now + delay_ms, callback);
+}
+
+//! \param[in] fd is the FileDescriptor to read
+//! \param[in] done is called with the bytes that were read, or an empty Buffer at EOF
+//! \param[in] limit is the maximum number of bytes to read (at most BufferPool::BLOCK_SIZE)
+void EventLoop::read_async(const FileDescriptor &fd, const ReadCallbackT &done, const size_t limit) {
+    if (_ring) {
+        const uint64_t id = _next_id++;
+        Operation &operation = _operations.emplace(id, Operation{fd.duplicate()}).first->second;
+        operation.length = min(limit, BufferPool::BLOCK_SIZE);
+        operation.block = BufferPool::acquire(operation.length);
+        operation.read_done = done;
+        _ring->prepare_read(fd.fd_num(), operation.block.data(), operation.length, id);
+        return;
+    }
+
+    // otherwise, read in a one-shot rule once fd is readable
+    const auto finished = make_shared<bool>(false);
+    const auto handle = make_shared<FileDescriptor>(fd.duplicate());
+    add_rule(
+        fd,
+        Direction::In,
+        [handle, finished, done, limit] {
+            Buffer data = handle->read_buffer(min(limit, BufferPool::BLOCK_SIZE));
+            *finished = true;
+            done(move(data));
+        },
+        [finished] { return not *finished; },
+        [finished, done] {
+            if (not *finished) {
+                *finished = true;
+                done(Buffer{});
+            }
+        });
+    _rules.back().finished = finished;
+}
+
+//! \param[in] fd is the FileDescriptor to write
+//! \param[in] buffers are the bytes to write; their storage must stay valid until `done` is called
+//! \param[in] done is called with the number of bytes written, which may be fewer than were given
+void EventLoop::writev_async(const FileDescriptor &fd, const BufferViewList &buffers, const WriteCallbackT &done) {
+    if (_ring) {
+        const uint64_t id = _next_id++;
+        Operation &operation = _operations.emplace(id, Operation{fd.duplicate()}).first->second;
+        operation.iovecs = buffers.as_iovecs();
+        operation.write_done = done;
+        _ring->prepare_writev(fd.fd_num(), operation.iovecs.data(), operation.iovecs.size(), id);
+        return;
+    }
+
+    // otherwise, write in a one-shot rule once fd is writable
+    const auto finished = make_shared<bool>(false);
+    const auto handle = make_shared<FileDescriptor>(fd.duplicate());
+    add_rule(
+        fd,
+        Direction::Out,
+        [handle, finished, buffers, done] {
+            const size_t bytes_written = handle->write(buffers, false);
+            *finished = true;
+            done(bytes_written);
+        },
+        [finished] { return not *finished; },
+        [finished, done] {
+            if (not *finished) {
+                *finished = true;
+                done(0);
+            }
+        });
+    _rules.back().finished = finished;
+}
+
+//! \param[in] fd_num is the fd whose registration is updated
+//! \details The fd is registered for the directions of its unparked rules, and unregistered
+//! (rather than registered for no events, which would still report hangups) if there are none.
+void EventLoop::update_registration(const int fd_num) {
+    const auto entry = _registrations.find(fd_num);
+    if (entry == _registrations.end()) {
+        return;
+    }
+    Registration &registration = entry->second;
+
+    uint32_t events = 0;
+    for (const auto &rule : registration.rules) {
+        if (not rule->parked) {
+            events |= epoll_events(rule->direction);
+        }
+    }
+    if (events != 0 and _backend == Backend::EpollEdge) {
+        events |= EPOLLET;
+    }
+
+    if (events == registration.events) {
+        // nothing to change
+    } else if (events == 0) {
+        // the fd may already have been closed, which removed it from the epoll set
+        if (::epoll_ctl(_epoll->fd_num(), EPOLL_CTL_DEL, fd_num, nullptr) < 0 and errno != EBADF and
+            errno != ENOENT) {
+            throw unix_error("epoll_ctl");
+        }
+    } else {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd_num;
+        const int op = registration.events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+        SystemCall("epoll_ctl", ::epoll_ctl(_epoll->fd_num(), op, fd_num, &event));
+    }
+    registration.events = events;
+
+    if (registration.rules.empty()) {
+        _registrations.erase(entry);
+    }
+}
+
+//! \param[in] rule is the rule to park
+void EventLoop::park_rule(const RuleIterator rule) {
+    rule->parked = true;
+    _parked.push_back(rule);
+    --_unparked;
+    update_registration(rule->fd.fd_num());
+}
+
+//! \param[in] rule is the rule to unpark (it must be parked, and the caller removes it from `_parked`)
+void EventLoop::unpark_rule(const RuleIterator rule) {
+    rule->parked = false;
+    ++_unparked;
+    update_registration(rule->fd.fd_num());
+}
+
+//! \param[in] rule is the rule to cancel
+//! \details The Rule itself is kept in `_canceled`, so that iterators to it held by the caller
+//! (or by `_parked`, from which it is dropped lazily) stay valid, but its fd and callbacks (which
+//! may hold further references to the fd) are released at once, so that canceling a rule closes
+//! the fd if nothing else holds it.
+void EventLoop::cancel_rule(const RuleIterator rule) {
+    rule->cancel();
+    rule->canceled = true;
+    if (not rule->parked) {
+        --_unparked;
+    }
+
+    if (_sweep == rule) {
+        ++*_sweep;
+    }
+
+    const int fd_num = rule->fd.fd_num();
+    auto &rules = _registrations.at(fd_num).rules;
+    rules.erase(find(rules.begin(), rules.end(), rule));
+    _canceled.splice(_canceled.end(), _rules, rule);
+    update_registration(fd_num);
+
+    const FileDescriptor released = move(rule->fd);
+    rule->callback = nullptr;
+    rule->interest = nullptr;
+    rule->cancel = nullptr;
+    rule->finished.reset();
+}
+
+//! \param[in] fd_num is the fd on which an error was reported
+//! \details Every MSG_ZEROCOPY completion is reported as an error, so this only looks at the rules
+//! on `fd_num`: its epoll registration, or the fds noted by the latest pass over the rules.
+bool EventLoop::handles_errors(const int fd_num) const {
+    if (_epoll.has_value()) {
+        const auto entry = _registrations.find(fd_num);
+        return entry != _registrations.end() and
+               any_of(entry->second.rules.begin(), entry->second.rules.end(), [](const RuleIterator rule) {
+                   return rule->direction == Direction::Error;
+               });
+    }
+    return find(_error_fds.begin(), _error_fds.end(), fd_num) != _error_fds.end();
 }
 
 //! \param[in] timeout_ms is the timeout value passed to [poll(2)](\ref man2::poll); `wait_next_event`
@@ -37,18 +271,20 @@ void EventLoop::add_rule(const FileDescriptor &fd,
 //! writability (if Rule::direction == Direction::Out) unless Rule::fd has reached EOF, in which case
 //! the Rule is canceled (i.e., deleted from EventLoop::_rules).
 //!
-//! Next, this function calls [poll(2)](\ref man2::poll) with timeout value `timeout_ms`.
+//! Next, this function calls [poll(2)](\ref man2::poll) with timeout value `timeout_ms`, or less
+//! if a timer added with EventLoop::add_timer expires sooner.
 //!
 //! Then, for each ready file descriptor, this function calls Rule::callback. If fd reaches EOF or
 //! if the Rule was registered using EventLoop::add_cancelable_rule and Rule::callback returns true,
-//! this Rule is canceled.
+//! this Rule is canceled. Finally, it calls back each timer that has expired.
 //!
 //! If an error occurs during polling, this function throws a std::runtime_error.
 //!
-//! If a [signal(7)](\ref man7::signal) was caught during polling or if EventLoop::_rules becomes empty,
-//! this function returns Result::Exit.
+//! If a [signal(7)](\ref man7::signal) was caught during polling or if EventLoop::_rules becomes empty
+//! (and there are no timers), this function returns Result::Exit.
 //!
-//! If a timeout occurred while polling (i.e., no fd became ready), this function returns Result::Timeout.
+//! If a timeout occurred while polling (i.e., no fd became ready) and no timer expired, this function
+//! returns Result::Timeout.
 //!
 //! Otherwise, this function returns Result::Success.
 //!
@@ -59,9 +295,49 @@ void EventLoop::add_rule(const FileDescriptor &fd,
 //! will result in a busy loop (poll returns on a ready file descriptor; file descriptor is not read or
 //! written, so it is still ready; the next call to poll will immediately return).
 EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
+    // wait no longer than until the nearest timer
+    _now = timestamp_ms();
+    int wait_ms = timeout_ms;
+    if (const auto deadline = _timers.next_deadline(); deadline.has_value()) {
+        const uint64_t until_deadline = deadline.value() > _now ? deadline.value() - _now : 0;
+        if (wait_ms < 0 or until_deadline < static_cast<uint64_t>(wait_ms)) {
+            wait_ms = static_cast<int>(min(until_deadline, uint64_t(numeric_limits<int>::max())));
+        }
+    }
+
+    Result result = Result::Exit;
+    _dispatching = true;
+    try {
+        switch (_backend) {
+            case Backend::Poll:
+                result = wait_next_event_poll(wait_ms);
+                break;
+            case Backend::EpollLevel:
+            case Backend::EpollEdge:
+                result = wait_next_event_epoll(wait_ms);
+                break;
+            case Backend::IoUring:
+                result = wait_next_event_uring(wait_ms);
+                break;
+        }
+
+        _now = timestamp_ms();
+        if (_timers.expire(_now) > 0 and result == Result::Timeout) {
+            result = Result::Success;
+        }
+    } catch (...) {
+        _dispatching = false;
+        throw;
+    }
+    _dispatching = false;
+    return result;
+}
+
+EventLoop::Result EventLoop::wait_next_event_poll(const int timeout_ms) {
     vector<pollfd> pollfds{};
     pollfds.reserve(_rules.size());
     bool something_to_poll = false;
+    _error_fds.clear();
 
     // set up the pollfd for each rule
     for (auto it = _rules.cbegin(); it != _rules.cend();) {  // NOTE: it gets erased or incremented in loop body
@@ -73,12 +349,15 @@ EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
             continue;
         }
 
-        if (this_rule.fd.closed()) {
+        if (this_rule.fd.closed() or this_rule.operation_finished()) {
             this_rule.cancel();
             it = _rules.erase(it);
             continue;
         }
 
+        if (this_rule.direction == Direction::Error) {
+            _error_fds.push_back(this_rule.fd.fd_num());
+        }
         if (this_rule.interest()) {
             pollfds.push_back({this_rule.fd.fd_num(), static_cast<short>(this_rule.direction), 0});
             something_to_poll = true;
@@ -88,8 +367,8 @@ EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
         ++it;
     }
 
-    // quit if there is nothing left to poll
-    if (not something_to_poll) {
+    // quit if there is nothing left to poll (or to wait for)
+    if (not something_to_poll and _timers.empty()) {
         return Result::Exit;
     }
 
@@ -103,13 +382,15 @@ EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
             return Result::Exit;
         }
     }
+    _now = timestamp_ms();  // for timers added by the callbacks
 
     // go through the poll results
 
     for (auto [it, idx] = make_pair(_rules.begin(), size_t(0)); it != _rules.end(); ++idx) {
         const auto &this_pollfd = pollfds[idx];
 
-        const auto poll_error = static_cast<bool>(this_pollfd.revents & (POLLERR | POLLNVAL));
+        const auto poll_error = static_cast<bool>(this_pollfd.revents & POLLNVAL) or
+                                (this_pollfd.revents & POLLERR and not handles_errors(this_pollfd.fd));
         if (poll_error) {
             throw runtime_error("EventLoop: error on polled file descriptor");
         }
@@ -143,3 +424,251 @@ EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
 
     return Result::Success;
 }
+
+//! \details Unlike wait_next_event_poll, this function does not visit every Rule on every call. It
+//! asks the parked rules whether they are interested again (unparking those that are), waits in
+//! [epoll_wait(2)](\ref man2::epoll_wait), and then dispatches only the rules on fds that epoll
+//! reported, checking each one's Rule::interest first and parking it if uninterested. A Rule is
+//! canceled on hangup, or when its fd reaches EOF or is closed; the latter conditions are checked
+//! for the parked rules, for the rules on each fd that was just serviced and, on a timeout (when
+//! the watched rules are also asked whether they are still interested), for every Rule.
+EventLoop::Result EventLoop::wait_next_event_epoll(const int timeout_ms) {
+    const auto is_defunct = [](const Rule &rule) {
+        return (rule.direction == Direction::In and rule.fd.eof()) or rule.fd.closed() or rule.operation_finished();
+    };
+
+    // revisit the parked rules: drop the canceled ones, cancel the defunct ones, and unpark the interested ones
+    for (size_t i = 0; i < _parked.size(); ++i) {
+        const RuleIterator rule = _parked[i];
+        if (not rule->canceled and is_defunct(*rule)) {
+            cancel_rule(rule);
+        } else if (not rule->canceled and rule->interest() and not rule->canceled) {
+            unpark_rule(rule);
+        } else {
+            continue;
+        }
+        _parked[i--] = _parked.back();
+        _parked.pop_back();
+    }
+    _parked.erase(remove_if(_parked.begin(), _parked.end(), [](const RuleIterator rule) { return rule->canceled; }),
+                  _parked.end());
+    _canceled.clear();
+
+    // quit if there is nothing left to wait for
+    if (_unparked == 0 and _timers.empty()) {
+        return Result::Exit;
+    }
+
+    constexpr size_t MAX_EVENTS = 256;
+    array<epoll_event, MAX_EVENTS> events{};
+    int event_count = 0;
+    try {
+        event_count = SystemCall("epoll_wait", ::epoll_wait(_epoll->fd_num(), events.data(), MAX_EVENTS, timeout_ms));
+    } catch (unix_error const &e) {
+        if (e.code().value() == EINTR) {
+            return Result::Exit;
+        }
+        throw;
+    }
+    _now = timestamp_ms();  // for timers added by the callbacks
+
+    if (event_count == 0) {
+        // with time to spare, look for rules that have become defunct or lost interest while their fds were idle
+        for (_sweep = _rules.begin(); *_sweep != _rules.end();) {  // NOTE: cancel_rule moves _sweep past the rule
+            const RuleIterator rule = (*_sweep)++;
+            if (is_defunct(*rule)) {
+                cancel_rule(rule);
+            } else if (not rule->parked and not rule->interest() and not rule->canceled) {
+                park_rule(rule);
+            }
+        }
+        _sweep.reset();
+        return Result::Timeout;
+    }
+
+    for (int i = 0; i < event_count; ++i) {
+        const int fd_num = events[i].data.fd;
+        const uint32_t revents = events[i].events;
+        const auto entry = _registrations.find(fd_num);
+        if (entry == _registrations.end()) {
+            continue;  // every rule on this fd was canceled while handling an earlier event
+        }
+
+        if (revents & EPOLLERR and not handles_errors(fd_num)) {
+            throw runtime_error("EventLoop: error on polled file descriptor");
+        }
+
+        // callbacks may add rules (and so purge the rules of an fd whose number is being reused),
+        // so work from a copy of this fd's rules and skip any that have been canceled since
+        vector<RuleIterator> hung_up{};
+        for (const auto rule : vector<RuleIterator>(entry->second.rules)) {
+            if (rule->canceled or rule->parked) {
+                continue;
+            }
+
+            const auto ready = static_cast<bool>(revents & epoll_events(rule->direction));
+            if (not ready) {
+                if (revents & EPOLLHUP) {
+                    // as with poll: if the _only_ condition was a hangup, this rule is defunct
+                    hung_up.push_back(rule);
+                }
+                continue;
+            }
+
+            if (not rule->interest()) {
+                park_rule(rule);
+                continue;
+            }
+
+            const auto count_before = rule->service_count();
+            rule->callback();
+            if (rule->canceled) {
+                continue;  // the callback added a rule that purged this one
+            }
+
+            // park the rule if it has lost interest; otherwise, it must have read or written its fd
+            if (not rule->interest()) {
+                if (not rule->canceled) {
+                    park_rule(rule);
+                }
+            } else if (count_before == rule->service_count()) {
+                throw runtime_error(
+                    "EventLoop: busy wait detected: callback did not read/write fd and is still interested");
+            }
+        }
+
+        // cancel the rules on this fd that hung up, reached EOF, or were closed by their callbacks
+        vector<RuleIterator> to_cancel{};
+        if (const auto current = _registrations.find(fd_num); current != _registrations.end()) {
+            for (const auto rule : current->second.rules) {
+                if (is_defunct(*rule) or find(hung_up.begin(), hung_up.end(), rule) != hung_up.end()) {
+                    to_cancel.push_back(rule);
+                }
+            }
+        }
+        for (const auto rule : to_cancel) {
+            cancel_rule(rule);
+        }
+    }
+
+    return Result::Success;
+}
+
+//! \param[in] rule is the rule whose poll is canceled
+//! \details The removal is submitted with the next batch; any completion of the poll is then ignored.
+void EventLoop::remove_poll(Rule &rule) {
+    if (rule.poll_id != 0) {
+        _ring->prepare_poll_remove(rule.poll_id, 0);
+        _polls.erase(rule.poll_id);
+        rule.poll_id = 0;
+    }
+}
+
+//! \details Like wait_next_event_poll, this function visits every Rule, canceling the defunct ones
+//! and queueing a one-shot poll for each interested Rule that does not already have one in flight.
+//! The polls, and the operations queued by read_async and writev_async, are then submitted and reaped
+//! with a single [io_uring_enter(2)](\ref man2::io_uring_enter). A completed poll is handled as a
+//! [poll(2)](\ref man2::poll) result would be, except that a Rule that has lost interest in the
+//! meantime is not called back; a completed Operation is passed to its callback.
+EventLoop::Result EventLoop::wait_next_event_uring(const int timeout_ms) {
+    bool something_to_wait_for = not _operations.empty();
+    _error_fds.clear();
+
+    for (auto it = _rules.begin(); it != _rules.end();) {  // NOTE: it gets erased or incremented in loop body
+        auto &this_rule = *it;
+        if ((this_rule.direction == Direction::In and this_rule.fd.eof()) or this_rule.fd.closed() or
+            this_rule.operation_finished()) {
+            remove_poll(this_rule);
+            this_rule.cancel();
+            it = _rules.erase(it);
+            continue;
+        }
+
+        if (this_rule.direction == Direction::Error) {
+            _error_fds.push_back(this_rule.fd.fd_num());
+        }
+        if (this_rule.interest()) {
+            if (this_rule.poll_id == 0) {
+                this_rule.poll_id = _next_id++;
+                _polls.emplace(this_rule.poll_id, it);
+                _ring->prepare_poll(this_rule.fd.fd_num(), static_cast<short>(this_rule.direction), this_rule.poll_id);
+            }
+            something_to_wait_for = true;
+        }
+        ++it;
+    }
+
+    // quit if there is nothing left to wait for
+    if (not something_to_wait_for and _timers.empty()) {
+        _ring->submit();  // in case polls were removed
+        return Result::Exit;
+    }
+
+    try {
+        if (not _ring->submit_and_wait(timeout_ms)) {
+            return Result::Timeout;
+        }
+    } catch (unix_error const &e) {
+        if (e.code().value() == EINTR) {
+            return Result::Exit;
+        }
+        throw;
+    }
+    _now = timestamp_ms();  // for timers added by the callbacks
+
+    while (const auto completion = _ring->pop_completion()) {
+        if (const auto poll = _polls.find(completion->user_data); poll != _polls.end()) {
+            const auto it = poll->second;
+            _polls.erase(poll);
+            it->poll_id = 0;
+
+            if (completion->result < 0) {
+                throw unix_error("io_uring poll", -completion->result);
+            }
+            const auto revents = static_cast<short>(completion->result);
+            const auto &this_rule = *it;
+            if (revents & POLLNVAL or (revents & POLLERR and not handles_errors(this_rule.fd.fd_num()))) {
+                throw runtime_error("EventLoop: error on polled file descriptor");
+            }
+
+            const auto poll_ready = static_cast<bool>(revents & static_cast<short>(this_rule.direction));
+            if (revents & POLLHUP and not poll_ready) {
+                // as with poll: if the _only_ condition was a hangup, this fd is defunct
+                this_rule.cancel();
+                _rules.erase(it);
+                continue;
+            }
+
+            // the rule may have lost interest since its poll was queued
+            if (poll_ready and this_rule.interest()) {
+                const auto count_before = this_rule.service_count();
+                this_rule.callback();
+
+                // only check for busy wait if we're not canceling or exiting
+                if (count_before == this_rule.service_count() and this_rule.interest()) {
+                    throw runtime_error(
+                        "EventLoop: busy wait detected: callback did not read/write fd and is still interested");
+                }
+            }
+        } else if (const auto entry = _operations.find(completion->user_data); entry != _operations.end()) {
+            Operation operation = move(entry->second);
+            _operations.erase(entry);
+
+            if (completion->result < 0) {
+                throw unix_error(operation.read_done ? "io_uring read" : "io_uring writev", -completion->result);
+            }
+            // keep the same accounting (and EOF flag) as the FileDescriptor calls that the other backends make
+            const auto result = static_cast<size_t>(completion->result);
+            if (operation.read_done) {
+                operation.fd.record_read(operation.length, result);
+                operation.read_done(result == 0 ? Buffer{} : Buffer::fitted(move(operation.block), result));
+            } else {
+                operation.fd.record_write();
+                operation.write_done(result);
+            }
+        }
+        // otherwise, this completes a poll that was removed, or the removal itself
+    }
+
+    return Result::Success;
+}
@@ -1,22 +1,50 @@
 #ifndef SPONGE_LIBSPONGE_EVENTLOOP_HH
 #define SPONGE_LIBSPONGE_EVENTLOOP_HH
 
+#include "buffer.hh"
 #include "file_descriptor.hh"
+#include "io_uring.hh"
+#include "timer_wheel.hh"
 
+#include <cstdint>
 #include <cstdlib>
 #include <functional>
 #include <list>
+#include <memory>
+#include <optional>
 #include <poll.h>
+#include <unordered_map>
+#include <vector>
 
 //! Waits for events on file descriptors and executes corresponding callbacks.
 class EventLoop {
   public:
-    //! Indicates interest in reading (In) or writing (Out) a polled fd.
+    //! Indicates interest in reading (In) or writing (Out) a polled fd, or in its error queue (Error).
     enum class Direction : short {
-        In = POLLIN,   //!< Callback will be triggered when Rule::fd is readable.
-        Out = POLLOUT  //!< Callback will be triggered when Rule::fd is writable.
+        In = POLLIN,     //!< Callback will be triggered when Rule::fd is readable.
+        Out = POLLOUT,   //!< Callback will be triggered when Rule::fd is writable.
+        Error = POLLERR  //!< Callback will be triggered when Rule::fd has a pending error (e.g., on its error queue).
     };
 
+    //! Returned by each call to EventLoop::wait_next_event.
+    enum class Result {
+        Success,  //!< At least one Rule or timer was triggered.
+        Timeout,  //!< No rules or timers were triggered before timeout.
+        Exit  //!< All rules have been canceled or were uninterested; make no further calls to EventLoop::wait_next_event.
+    };
+
+    //! Selects the system call that EventLoop::wait_next_event uses to wait for ready fds.
+    enum class Backend {
+        Poll,        //!< [poll(2)](\ref man2::poll) on every Rule, rebuilt on each call (the default)
+        EpollLevel,  //!< level-triggered [epoll(7)](\ref man7::epoll); each fd is registered once
+        EpollEdge,   //!< edge-triggered [epoll(7)](\ref man7::epoll); callbacks must drain their fd
+        IoUring      //!< batched [io_uring(7)](\ref man7::io_uring) polls and operations; Poll if unsupported
+    };
+
+    using ReadCallbackT = std::function<void(Buffer)>;   //!< Receives the bytes read by EventLoop::read_async
+    using WriteCallbackT = std::function<void(size_t)>;  //!< Receives the byte count from EventLoop::writev_async
+    using TimerId = TimerWheel::TimerId;                 //!< Identifies a timer added by EventLoop::add_timer
+
   private:
     using CallbackT = std::function<void(void)>;  //!< Callback for ready Rule::fd
     using InterestT = std::function<bool(void)>;  //!< `true` return indicates Rule::fd should be polled.
@@ -25,26 +53,104 @@ class EventLoop {
     //! \details Created by calling EventLoop::add_rule() or EventLoop::add_cancelable_rule().
     class Rule {
       public:
-        FileDescriptor fd;    //!< FileDescriptor to monitor for activity.
-        Direction direction;  //!< Direction::In for reading from fd, Direction::Out for writing to fd.
-        CallbackT callback;   //!< A callback that reads or writes fd.
-        InterestT interest;   //!< A callback that returns `true` whenever fd should be polled.
-        CallbackT cancel;     //!< A callback that is called when the rule is cancelled (e.g. on hangup)
+        FileDescriptor fd;      //!< FileDescriptor to monitor for activity.
+        Direction direction;    //!< Direction::In for reading from fd, Direction::Out for writing to fd.
+        CallbackT callback;     //!< A callback that reads or writes fd.
+        InterestT interest;     //!< A callback that returns `true` whenever fd should be polled.
+        CallbackT cancel;       //!< A callback that is called when the rule is cancelled (e.g. on hangup)
+        bool parked = false;    //!< (epoll only) Rule::interest returned `false`, so fd is not being watched
+        bool canceled = false;  //!< (epoll only) The rule has been canceled, and is kept only as a placeholder
+        uint64_t poll_id = 0;   //!< (io_uring only) Identifies the poll in flight for this Rule, or 0 if none
+
+        //! (async operations) Set once the operation has been performed, after which the Rule is dropped
+        std::shared_ptr<const bool> finished{};
 
-        //! Returns the number of times fd has been read or written, depending on the value of Rule::direction.
+        //! Returns the number of times fd has been read (for Direction::In or Direction::Error) or written.
         //! \details This function is used internally by EventLoop; you will not need to call it
         unsigned int service_count() const;
+
+        //! Returns `true` if this Rule performs an async operation that has been performed.
+        bool operation_finished() const { return finished and *finished; }
+    };
+
+    using RuleIterator = std::list<Rule>::iterator;
+
+    //! \brief (epoll only) The epoll registration of one fd, shared by all Rule objects on that fd.
+    struct Registration {
+        uint32_t events = 0;                //!< Events the fd is currently registered for (0 if unregistered)
+        std::vector<RuleIterator> rules{};  //!< The rules on this fd
+    };
+
+    //! \brief (io_uring only) A read or writev in flight, with the storage it uses.
+    struct Operation {
+        FileDescriptor fd;            //!< The fd being read or written
+        BufferPool::Block block{};    //!< (read) The pooled block being read into
+        size_t length = 0;            //!< (read) The number of bytes asked for
+        std::vector<iovec> iovecs{};  //!< (writev) The buffers being written
+        ReadCallbackT read_done{};    //!< (read) Called with the bytes read
+        WriteCallbackT write_done{};  //!< (writev) Called with the number of bytes written
     };
 
+    Backend _backend;          //!< How wait_next_event waits for ready fds.
     std::list<Rule> _rules{};  //!< All rules that have been added and not canceled.
 
+    uint64_t _now;              //!< The latest reading of the clock, in ms; timer delays are measured from here
+    TimerWheel _timers;         //!< Timers that have been added and have not fired or been canceled
+    bool _dispatching = false;  //!< Whether wait_next_event is running (and so keeping _now up to date)
+
+    std::optional<FileDescriptor> _epoll{};                  //!< The epoll instance, unless _backend is Poll
+    std::unordered_map<int, Registration> _registrations{};  //!< Registrations, by fd number
+    std::vector<RuleIterator> _parked{};                     //!< (epoll only) Parked rules (and some canceled ones)
+    size_t _unparked = 0;                                    //!< (epoll only) Number of rules being watched
+    std::optional<RuleIterator> _sweep{};                    //!< (epoll only) The next rule to visit, while visiting
+
+    //! (epoll only) Canceled rules, emptied of their fd and callbacks but kept until the next
+    //! wait_next_event so that iterators to them (e.g., in `_parked`) stay valid
+    std::list<Rule> _canceled{};
+
+    //! (poll and io_uring only) The fds with a Direction::Error rule, as of the latest pass over the rules
+    std::vector<int> _error_fds{};
+
+    uint64_t _next_id = 1;                                  //!< (io_uring only) Next id for a poll or Operation
+    std::unordered_map<uint64_t, RuleIterator> _polls{};    //!< (io_uring only) Rules with a poll in flight, by id
+    std::unordered_map<uint64_t, Operation> _operations{};  //!< (io_uring only) Operations in flight, by id
+
+    //! (io_uring only) The ring, declared last so that it is destroyed (canceling what is in flight) first
+    std::unique_ptr<IOUring> _ring{};
+
+    //! wait_next_event for Backend::Poll
+    Result wait_next_event_poll(const int timeout_ms);
+
+    //! wait_next_event for Backend::EpollLevel and Backend::EpollEdge
+    Result wait_next_event_epoll(const int timeout_ms);
+
+    //! wait_next_event for Backend::IoUring
+    Result wait_next_event_uring(const int timeout_ms);
+
+    //! (io_uring only) Cancel the poll in flight for a rule, if any
+    void remove_poll(Rule &rule);
+
+    //! (epoll only) Bring the epoll registration of `fd_num` in line with its unparked rules.
+    void update_registration(const int fd_num);
+
+    //! (epoll only) Stop watching a rule until its Rule::interest returns `true` again.
+    void park_rule(const RuleIterator rule);
+
+    //! (epoll only) Watch a parked rule again.
+    void unpark_rule(const RuleIterator rule);
+
+    //! (epoll only) Call Rule::cancel, forget the rule, and release its fd and callbacks.
+    void cancel_rule(const RuleIterator rule);
+
+    //! Whether some Rule on `fd_num` will handle its errors (otherwise, an error is thrown as an exception).
+    bool handles_errors(const int fd_num) const;
+
   public:
-    //! Returned by each call to EventLoop::wait_next_event.
-    enum class Result {
-        Success,  //!< At least one Rule was triggered.
-        Timeout,  //!< No rules were triggered before timeout.
-        Exit  //!< All rules have been canceled or were uninterested; make no further calls to EventLoop::wait_next_event.
-    };
+    //! Construct an EventLoop that waits using the given Backend.
+    explicit EventLoop(const Backend backend = Backend::Poll);
+
+    //! The Backend in use, which is Backend::Poll if Backend::IoUring was requested but is not supported
+    Backend backend() const { return _backend; }
 
     //! Add a rule whose callback will be called when `fd` is ready in the specified Direction.
     void add_rule(const FileDescriptor &fd,
@@ -53,7 +159,20 @@ class EventLoop {
                   const InterestT &interest = [] { return true; },
                   const CallbackT &cancel = [] {});
 
-    //! Calls [poll(2)](\ref man2::poll) and then executes callback for each ready fd.
+    //! Call `callback` from wait_next_event once `delay_ms` have passed; returns an id for cancel_timer.
+    TimerId add_timer(const uint64_t delay_ms, const CallbackT &callback);
+
+    //! Cancel a timer; returns `false` if it has already fired or been canceled.
+    bool cancel_timer(const TimerId id) { return _timers.cancel(id); }
+
+    //! Read once from `fd` into a pooled Buffer and pass the bytes to `done` (an empty Buffer at EOF).
+    void read_async(const FileDescriptor &fd, const ReadCallbackT &done, const size_t limit = BufferPool::BLOCK_SIZE);
+
+    //! Write `buffers` to `fd` with a single writev, and pass the number of bytes written to `done`.
+    void writev_async(const FileDescriptor &fd, const BufferViewList &buffers, const WriteCallbackT &done);
+
+    //! Calls [poll(2)](\ref man2::poll) (or [epoll_wait(2)](\ref man2::epoll_wait) or
+    //! [io_uring_enter(2)](\ref man2::io_uring_enter)) and then executes callback for each ready fd.
     Result wait_next_event(const int timeout_ms);
 };
 
@@ -72,5 +191,41 @@ using Direction = EventLoop::Direction;
 //! A Rule installed using EventLoop::add_cancelable_rule will be polled and canceled under the
 //! same conditions, with the additional condition that if Rule::callback returns `true`, the
 //! Rule will be canceled.
+//!
+//! An EventLoop constructed with Backend::EpollLevel or Backend::EpollEdge instead registers each fd
+//! with [epoll(7)](\ref man7::epoll) once, when its first Rule is added, rather than rebuilding and
+//! passing the whole set to the kernel on every call, and each call to EventLoop::wait_next_event
+//! does work only for the rules that need it. A Rule whose Rule::interest returns `false` when its
+//! fd is reported ready is parked (its fd is no longer watched for that direction), and parked rules
+//! (which include newly added ones) are asked again at the start of each call, and unparked once
+//! interested, so [epoll_ctl(2)](\ref man2::epoll_ctl) is called only when a Rule's interest changes.
+//! The rules that are being watched are asked only when their fd is ready, or when a wait times
+//! out, when every Rule is visited (and the rules whose fds have reached EOF or been closed are
+//! canceled). EventLoop::wait_next_event returns Result::Exit once every remaining Rule is parked, so
+//! a Rule that loses interest while its fd is idle delays that until its fd is ready or a wait times out.
+//!
+//! With Backend::EpollEdge, readiness is reported only when it changes, so a callback must read or
+//! write until its fd would block (or the Rule must stop being interested), or it may not be called again.
+//!
+//! An error on a polled fd makes EventLoop::wait_next_event throw std::runtime_error, unless the fd
+//! has a Rule with Direction::Error. That Rule's callback is then responsible for the error, e.g. by
+//! draining the socket's error queue (see TCPSocket::reap_zerocopy), which must count as a read.
+//!
+//! Timers added with EventLoop::add_timer are kept in a TimerWheel, and EventLoop::wait_next_event
+//! waits no longer than until the nearest of them, then calls back those that have expired. Each
+//! call reads the clock before waiting, when the wait ends, and before expiring timers; a timer
+//! added from a callback has its delay measured from the latest of those readings, so adding it
+//! costs no further reading of the clock. (Elsewhere, EventLoop::add_timer reads the clock itself.)
+//! While timers are pending, EventLoop::wait_next_event does not return Result::Exit, even if there are no rules.
+//!
+//! With Backend::IoUring, each call to EventLoop::wait_next_event queues a one-shot poll for every
+//! interested Rule that does not already have one in flight, and then submits them, together with
+//! any operations queued by EventLoop::read_async and EventLoop::writev_async, and waits for
+//! completions in a single [io_uring_enter(2)](\ref man2::io_uring_enter). Those operations are
+//! performed by the kernel, so completing them costs no further system calls; with the other
+//! backends they are performed by one-shot rules when their fd is ready. Either way, the storage
+//! behind the BufferViewList given to EventLoop::writev_async must stay valid until `done` is called,
+//! and if `fd` hangs up before a rule-based operation is performed, `done` is called with an
+//! empty Buffer or a count of 0.
 
 #endif  // SPONGE_LIBSPONGE_EVENTLOOP_HH
@@ -0,0 +1,172 @@
+#include "eventloop_group.hh"
+
+#include "util.hh"
+
+#include <algorithm>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+//! The CPUs that this process may run on
+static vector<int> allowed_cpus() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    SystemCall("sched_getaffinity", sched_getaffinity(0, sizeof(allowed), &allowed));
+
+    vector<int> cpus{};
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+//! \param[in] threads is the number of loops, or 0 for one per CPU in the process's affinity mask
+//! \param[in] distribution is how dispatch() chooses a loop
+//! \param[in] backend is the EventLoop::Backend for every loop
+//! \param[in] pin_threads pins the loops' threads to distinct CPUs (as far as there are enough)
+EventLoopGroup::EventLoopGroup(const size_t threads,
+                               const Distribution distribution,
+                               const EventLoop::Backend backend,
+                               const bool pin_threads)
+    : _distribution(distribution) {
+    const vector<int> cpus = allowed_cpus();
+    const size_t count = threads > 0 ? threads : max(cpus.size(), size_t(1));
+
+    for (size_t i = 0; i < count; ++i) {
+        auto worker = make_unique<Worker>(backend);
+        worker->loop.add_rule(worker->tasks.event(), Direction::In, [&tasks = worker->tasks] { tasks.run_pending(); });
+        _workers.push_back(move(worker));
+    }
+
+    try {
+        for (size_t i = 0; i < count; ++i) {
+            Worker &worker = *_workers[i];
+            worker.thread = thread([this, &worker] { run(worker); });
+
+            if (pin_threads and not cpus.empty()) {
+                cpu_set_t cpu;
+                CPU_ZERO(&cpu);
+                CPU_SET(cpus[i % cpus.size()], &cpu);
+                const int error = pthread_setaffinity_np(worker.thread.native_handle(), sizeof(cpu), &cpu);
+                if (error != 0) {
+                    throw unix_error("pthread_setaffinity_np", error);
+                }
+            }
+        }
+    } catch (...) {
+        join_threads();
+        throw;
+    }
+}
+
+EventLoopGroup::~EventLoopGroup() {
+    try {
+        stop();
+    } catch (const exception &e) {
+        // don't throw an exception from the destructor
+        cerr << "Exception in EventLoopGroup thread: " << e.what() << endl;
+    }
+}
+
+//! \param[in] worker is the loop to run, on the calling thread, until stop()
+void EventLoopGroup::run(Worker &worker) {
+    try {
+        // the task queue's rule is never canceled, so the loop only returns Exit if a signal interrupts it
+        while (not _stopping) {
+            worker.loop.wait_next_event(-1);
+        }
+    } catch (...) {
+        const lock_guard<mutex> lock(_error_mutex);
+        if (not _error) {
+            _error = current_exception();
+        }
+    }
+}
+
+//! \param[in] index is the loop to run the task on, in [0, size())
+//! \param[in] task is called with the loop, on the loop's thread
+void EventLoopGroup::post(const size_t index, const TaskT &task) {
+    Worker &worker = *_workers.at(index);
+    worker.tasks.push([&loop = worker.loop, task] { task(loop); });
+}
+
+//! \param[in] socket is a connected socket
+//! \returns the index of a loop, per the group's Distribution
+size_t EventLoopGroup::select(const Socket &socket) {
+    if (_distribution == Distribution::Hash) {
+        return hash<string>{}(socket.peer_address().ip()) % _workers.size();
+    }
+    return _next_worker++ % _workers.size();
+}
+
+//! \param[in] socket is a connected socket (e.g., from TCPSocket::accept) to hand over
+//! \param[in] handler is called on the chosen loop's thread with the loop and the socket
+//! \returns the index of the chosen loop
+size_t EventLoopGroup::dispatch(TCPSocket &&socket, const SocketHandlerT &handler) {
+    const size_t index = select(socket);
+
+    // a std::function must be copyable, so the socket travels in a shared_ptr
+    const auto owned = make_shared<TCPSocket>(move(socket));
+    post(index, [owned, handler](EventLoop &loop) { handler(loop, move(*owned)); });
+    return index;
+}
+
+//! \param[in] address is the address to listen on (if its port is 0, one port is chosen for all loops)
+//! \param[in] handler is called with each accepted socket, on the thread of the loop that accepted it
+//! \param[in] backlog is the length of each listening socket's queue of pending connections
+//! \returns the address being listened on
+//! \details Because the kernel queues each new connection on exactly one of the listening sockets,
+//! a loop whose socket is readable can accept without racing other loops. Each wakeup accepts the
+//! whole burst of waiting connections with TCPSocket::accept_batch, so the accepted sockets are
+//! non-blocking.
+Address EventLoopGroup::listen(const Address &address, const SocketHandlerT &handler, const int backlog) {
+    // bind every socket before any loop accepts, so that failures are reported here
+    vector<shared_ptr<TCPSocket>> listeners{};
+    Address bound = address;
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        auto listener = make_shared<TCPSocket>();
+        listener->set_reuseaddr();
+        listener->set_reuseport();
+        listener->bind(bound);
+        listener->listen(backlog);
+        listener->set_blocking(false);
+        bound = listener->local_address();
+        listeners.push_back(move(listener));
+    }
+
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        post(i, [listener = listeners[i], handler](EventLoop &loop) {
+            loop.add_rule(*listener, Direction::In, [listener, handler, &loop] {
+                for (auto &socket : listener->accept_batch()) {
+                    handler(loop, move(socket));
+                }
+            });
+        });
+    }
+    return bound;
+}
+
+void EventLoopGroup::join_threads() {
+    _stopping = true;
+    for (auto &worker : _workers) {
+        if (worker->thread.joinable()) {
+            worker->tasks.push([] {});  // wake the loop so that it sees `_stopping`
+            worker->thread.join();
+        }
+    }
+}
+
+void EventLoopGroup::stop() {
+    join_threads();
+
+    const lock_guard<mutex> lock(_error_mutex);
+    if (_error) {
+        rethrow_exception(exchange(_error, nullptr));
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef SPONGE_LIBSPONGE_EVENTLOOP_GROUP_HH
+#define SPONGE_LIBSPONGE_EVENTLOOP_GROUP_HH
+
+#include "eventloop.hh"
+#include "socket.hh"
+#include "task_queue.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! \brief Runs one EventLoop per thread, each thread pinned to its own CPU, and spreads work across them.
+
+//! Each loop has a TaskQueue, watched by a Rule on the loop itself, so any thread (including
+//! another loop's) can post() work onto it without locks. Connections are handed to the loops
+//! with dispatch(), which picks a loop round-robin or by a hash of the peer's IP address (so
+//! that all connections from one host are served by the same loop), and then calls a handler
+//! on that loop's thread to add the socket's rules:
+//!
+//! ~~~{.cc}
+//! EventLoopGroup group{};
+//! while (true) {
+//!     group.dispatch(listener.accept(), [](EventLoop &loop, TCPSocket &&socket) {
+//!         // ... add rules for the socket to `loop`
+//!     });
+//! }
+//! ~~~
+//!
+//! Alternatively, listen() gives every loop its own listening socket on the same address (with
+//! `SO_REUSEPORT`), so that the kernel spreads incoming connections across the loops and each
+//! loop accepts its own, with no accept thread and no handoff between threads.
+//!
+//! A loop and everything added to it must then only be used from its own thread.
+class EventLoopGroup {
+  public:
+    //! How dispatch() chooses a loop
+    enum class Distribution {
+        RoundRobin,  //!< Each connection goes to the next loop in turn
+        Hash         //!< Each connection goes to the loop chosen by a hash of its peer's IP address
+    };
+
+    using TaskT = std::function<void(EventLoop &)>;                         //!< Work posted onto a loop
+    using SocketHandlerT = std::function<void(EventLoop &, TCPSocket &&)>;  //!< Takes over a dispatched socket
+
+  private:
+    //! \brief A loop, its task queue, and the thread that runs them
+    struct Worker {
+        EventLoop loop;        //!< The loop, used only from `thread`
+        TaskQueue tasks{};     //!< Work posted onto the loop
+        std::thread thread{};  //!< Runs the loop
+
+        //! Construct a worker whose loop uses `backend`
+        explicit Worker(const EventLoop::Backend backend) : loop(backend) {}
+    };
+
+    Distribution _distribution;                       //!< How dispatch() chooses a loop
+    std::vector<std::unique_ptr<Worker>> _workers{};  //!< One per thread
+    std::atomic<size_t> _next_worker{0};              //!< The next loop for Distribution::RoundRobin
+    std::atomic<bool> _stopping{false};               //!< Set by stop() to end the threads
+
+    std::mutex _error_mutex{};    //!< Protects `_error`
+    std::exception_ptr _error{};  //!< The first exception thrown on a worker thread
+
+    //! The body of each worker thread
+    void run(Worker &worker);
+
+    //! End the worker threads and wait for them
+    void join_threads();
+
+  public:
+    //! Start `threads` loops (0 for one per CPU this process may run on), pinned if `pin_threads`
+    explicit EventLoopGroup(const size_t threads = 0,
+                            const Distribution distribution = Distribution::RoundRobin,
+                            const EventLoop::Backend backend = EventLoop::Backend::EpollLevel,
+                            const bool pin_threads = true);
+
+    //! Stop the loops and wait for their threads
+    ~EventLoopGroup();
+
+    //! Number of loops
+    size_t size() const { return _workers.size(); }
+
+    //! Run `task` on the thread of loop `index` (from any thread)
+    void post(const size_t index, const TaskT &task);
+
+    //! The loop that dispatch() would choose for `socket`
+    size_t select(const Socket &socket);
+
+    //! Hand `socket` to a loop, chosen by select(), and call `handler` with it on that loop's thread
+    size_t dispatch(TCPSocket &&socket, const SocketHandlerT &handler);
+
+    //! Accept connections to `address` on every loop, each through its own listening socket
+    Address listen(const Address &address, const SocketHandlerT &handler, const int backlog = 16);
+
+    //! Stop the loops (discarding tasks that have not run), wait for their threads, and rethrow the
+    //! first exception thrown on any of them
+    void stop();
+
+    //! \name
+    //! An EventLoopGroup cannot be copied or moved
+
+    //!@{
+    EventLoopGroup(const EventLoopGroup &other) = delete;
+    EventLoopGroup &operator=(const EventLoopGroup &other) = delete;
+    EventLoopGroup(EventLoopGroup &&other) = delete;
+    EventLoopGroup &operator=(EventLoopGroup &&other) = delete;
+    //!@}
+};
+
+#endif  // SPONGE_LIBSPONGE_EVENTLOOP_GROUP_HH
@@ -3,9 +3,13 @@
 #include "util.hh"
 
 #include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
 #include <fcntl.h>
 #include <iostream>
 #include <stdexcept>
+#include <sys/sendfile.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
@@ -44,23 +48,71 @@ FileDescriptor::FileDescriptor(shared_ptr<FDWrapper> other_shared_ptr) : _intern
 //! \returns a copy of this FileDescriptor
 FileDescriptor FileDescriptor::duplicate() const { return FileDescriptor(_internal_fd); }
 
-//! \param[in] limit is the maximum number of bytes to read; fewer bytes may be returned
-//! \param[out] str is the string to be read
-void FileDescriptor::read(std::string &str, const size_t limit) {
-    constexpr size_t BUFFER_SIZE = 1024 * 1024;  // maximum size of a read
-    const size_t size_to_read = min(BUFFER_SIZE, limit);
-    str.resize(size_to_read);
+//! Maximum size of a read into a std::string or a BufferList
+static constexpr size_t MAX_READ_SIZE = 1024 * 1024;
+
+//! Maximum number of pooled blocks filled by a read
+static constexpr size_t MAX_READ_BLOCKS = MAX_READ_SIZE / BufferPool::BLOCK_SIZE;
+
+//! Borrow as many pooled blocks as a read of up to `limit` bytes calls for (at most MAX_READ_BLOCKS,
+//! each of the smallest size class that holds its share), and describe them in `iovecs`
+//! \returns the number of blocks borrowed
+static size_t borrow_blocks(const size_t limit,
+                            array<BufferPool::Block, MAX_READ_BLOCKS> &blocks,
+                            array<iovec, MAX_READ_BLOCKS> &iovecs) {
+    constexpr size_t BLOCK_SIZE = BufferPool::BLOCK_SIZE;
+    const size_t block_count = min(MAX_READ_BLOCKS, limit / BLOCK_SIZE + (limit % BLOCK_SIZE != 0));
+    size_t remaining = limit;
+    for (size_t i = 0; i < block_count; ++i) {
+        blocks[i] = BufferPool::acquire(min(BLOCK_SIZE, remaining));
+        iovecs[i] = {blocks[i].data(), min(BLOCK_SIZE, remaining)};
+        remaining -= iovecs[i].iov_len;
+    }
+    return block_count;
+}
 
-    ssize_t bytes_read = SystemCall("read", ::read(fd_num(), str.data(), size_to_read));
-    if (limit > 0 && bytes_read == 0) {
+//! \param[in] size_to_read is the number of bytes that were asked for
+//! \param[in] bytes_read is the number of bytes that were read (0 means EOF, if any were asked for)
+void FileDescriptor::record_read(const size_t size_to_read, const size_t bytes_read) {
+    if (size_to_read > 0 and bytes_read == 0) {
         _internal_fd->_eof = true;
     }
+    register_read();
+}
+
+//! \param[in] buffer is where the bytes are placed
+//! \param[in] size_to_read is the maximum number of bytes to read
+//! \returns the number of bytes read
+size_t FileDescriptor::read_into(char *buffer, const size_t size_to_read) {
+    const ssize_t bytes_read = SystemCall("read", ::read(fd_num(), buffer, size_to_read));
     if (bytes_read > static_cast<ssize_t>(size_to_read)) {
         throw runtime_error("read() read more than requested");
     }
-    str.resize(bytes_read);
 
-    register_read();
+    record_read(size_to_read, bytes_read);
+
+    return bytes_read;
+}
+
+//! \param[in] limit is the maximum number of bytes to read; fewer bytes may be returned
+//! \param[out] str is the string to be read
+//! \details A single [readv(2)](\ref man2::readv) fills pooled blocks, as a read into a BufferList
+//! does (up to 1 MiB's worth), and the bytes read are then copied into `str`. The blocks are not
+//! zero-filled, and go back to the pool afterwards, so no read allocates more than the string, and
+//! a short read costs only as much as the bytes it returns.
+void FileDescriptor::read(std::string &str, const size_t limit) {
+    array<BufferPool::Block, MAX_READ_BLOCKS> blocks{};
+    array<iovec, MAX_READ_BLOCKS> iovecs{};
+    const size_t block_count = borrow_blocks(limit, blocks, iovecs);
+
+    size_t left = readv(iovecs.data(), block_count);
+    str.clear();
+    str.reserve(left);
+    for (size_t i = 0; left > 0; ++i) {
+        const size_t size = min(left, iovecs[i].iov_len);
+        str.append(blocks[i].data(), size);
+        left -= size;
+    }
 }
 
 //! \param[in] limit is the maximum number of bytes to read; fewer bytes may be returned
@@ -73,31 +125,144 @@ string FileDescriptor::read(const size_t limit) {
     return ret;
 }
 
-size_t FileDescriptor::write(BufferViewList buffer, const bool write_all) {
+//! \param[in] limit is the maximum number of bytes to read; at most BufferPool::BLOCK_SIZE are read
+//! \returns a Buffer holding the bytes read
+//! \details The bytes are read straight into a pooled block (of the smallest size class that
+//! holds `limit`), with no zero-filling. A short read that fits a smaller size class is copied
+//! into a block of that class instead.
+Buffer FileDescriptor::read_buffer(const size_t limit) {
+    const size_t size_to_read = min(BufferPool::BLOCK_SIZE, limit);
+    BufferPool::Block block = BufferPool::acquire(size_to_read);
+    const size_t bytes_read = read_into(block.data(), size_to_read);
+    return Buffer::fitted(move(block), bytes_read);
+}
+
+//! \param[out] buffers is the BufferList to which the bytes read are appended
+//! \param[in] limit is the maximum number of bytes to read; fewer bytes may be returned
+//! \returns the number of bytes read (0 at EOF)
+//! \details A single [readv(2)](\ref man2::readv) fills as many pooled blocks as `limit` calls for
+//! (up to 1 MiB's worth), and each block that received bytes is appended as a Buffer of its own,
+//! so a large read needs no large allocation and no copy. As with read_buffer(), a partly filled
+//! block is copied into a smaller one if it fits; unused blocks go straight back to the pool.
+size_t FileDescriptor::read(BufferList &buffers, const size_t limit) {
+    array<BufferPool::Block, MAX_READ_BLOCKS> blocks{};
+    array<iovec, MAX_READ_BLOCKS> iovecs{};
+    const size_t block_count = borrow_blocks(limit, blocks, iovecs);
+
+    const size_t bytes_read = readv(iovecs.data(), block_count);
+    if (bytes_read == 0) {
+        return 0;
+    }
+    size_t left = bytes_read;
+    for (size_t i = 0; left > 0; ++i) {
+        const size_t size = min(left, iovecs[i].iov_len);
+        buffers.append(Buffer::fitted(move(blocks[i]), size));
+        left -= size;
+    }
+    return bytes_read;
+}
+
+//! \param[in] iov describes the storage to fill, in order
+//! \param[in] iovcnt is the number of entries in `iov`
+//! \returns the number of bytes read, which may be fewer than requested
+size_t FileDescriptor::readv(const iovec *iov, const size_t iovcnt) {
+    size_t size_to_read = 0;
+    for (size_t i = 0; i < iovcnt; ++i) {
+        size_to_read += iov[i].iov_len;
+    }
+
+    const ssize_t bytes_read = SystemCall("readv", ::readv(fd_num(), iov, iovcnt));
+    if (bytes_read > static_cast<ssize_t>(size_to_read)) {
+        throw runtime_error("readv() read more than requested");
+    }
+
+    record_read(size_to_read, bytes_read);
+
+    return bytes_read;
+}
+
+size_t FileDescriptor::write(const BufferViewList &buffer, const bool write_all) {
+    // a writev takes at most IOV_MAX entries; the cursor feeds them in and steps past short writes
+    array<iovec, IOV_MAX> iovecs;
+    IovecCursor cursor{buffer, iovecs.data(), iovecs.size()};
     size_t total_bytes_written = 0;
 
     do {
-        auto iovecs = buffer.as_iovecs();
-
-        const ssize_t bytes_written = SystemCall("writev", ::writev(fd_num(), iovecs.data(), iovecs.size()));
-        if (bytes_written == 0 and buffer.size() != 0) {
+        const ssize_t bytes_written = SystemCall("writev", ::writev(fd_num(), cursor.iovecs(), cursor.count()));
+        if (bytes_written == 0 and not cursor.done()) {
             throw runtime_error("write returned 0 given non-empty input buffer");
         }
 
-        if (bytes_written > ssize_t(buffer.size())) {
+        if (bytes_written > ssize_t(cursor.remaining())) {
             throw runtime_error("write wrote more than length of input buffer");
         }
 
         register_write();
 
-        buffer.remove_prefix(bytes_written);
+        cursor.advance(bytes_written);
 
         total_bytes_written += bytes_written;
-    } while (write_all and buffer.size());
+    } while (write_all and not cursor.done());
 
     return total_bytes_written;
 }
 
+//! \param[in] destination is where the bytes go (any fd, but usually a socket)
+//! \param[in] offset is where in this file to start; the file's own offset is left alone
+//! \param[in] length is the number of bytes to send
+//! \param[in] send_all keeps sending until `length` bytes are sent (otherwise, sends once, and returns 0
+//!                     instead of throwing if a non-blocking `destination` is full)
+//! \returns the number of bytes sent, which is less than `length` if the file ends first
+//! \details The bytes go from the page cache to `destination` inside the kernel, never through user space.
+size_t FileDescriptor::sendfile_to(FileDescriptor &destination,
+                                   const off_t offset,
+                                   const size_t length,
+                                   const bool send_all) {
+    off_t position = offset;
+    size_t total_bytes_sent = 0;
+    while (total_bytes_sent < length) {
+        const ssize_t bytes_sent = ::sendfile(destination.fd_num(), fd_num(), &position, length - total_bytes_sent);
+        if (SystemCall("sendfile", bytes_sent, send_all ? 0 : EAGAIN) < 0) {
+            break;
+        }
+
+        register_read();
+        destination.register_write();
+        if (bytes_sent == 0) {
+            break;  // the file ended
+        }
+        total_bytes_sent += bytes_sent;
+        if (not send_all) {
+            break;
+        }
+    }
+
+    return total_bytes_sent;
+}
+
+//! \param[in] destination is where the bytes go; it, or this FileDescriptor, must be a pipe
+//! \param[in] limit is the most bytes to move
+//! \returns the number of bytes moved, which is 0 at EOF (setting eof()), or if the pipe (or a
+//!          non-blocking socket) is full or empty
+//! \details The pipe's pages are handed on rather than copied where the kernel can manage it. A
+//! socket-to-socket (or file-to-socket) transfer takes two splices, through a pipe; see SpliceRelay.
+size_t FileDescriptor::splice_to(FileDescriptor &destination, const size_t limit) {
+    const ssize_t bytes_moved = SystemCall(
+        "splice",
+        ::splice(fd_num(), nullptr, destination.fd_num(), nullptr, limit, SPLICE_F_MOVE | SPLICE_F_NONBLOCK),
+        EAGAIN);
+    if (bytes_moved < 0) {
+        return 0;
+    }
+    if (limit > 0 and bytes_moved == 0) {
+        _internal_fd->_eof = true;
+    }
+
+    register_read();
+    destination.register_write();
+    return bytes_moved;
+}
+
 void FileDescriptor::set_blocking(const bool blocking_state) {
     int flags = SystemCall("fcntl", fcntl(fd_num(), F_GETFL));
     if (blocking_state) {
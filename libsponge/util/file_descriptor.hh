@@ -7,6 +7,7 @@
 #include <cstddef>
 #include <limits>
 #include <memory>
+#include <sys/types.h>
 
 //! A reference-counted handle to a file descriptor
 class FileDescriptor {
@@ -44,6 +45,9 @@ class FileDescriptor {
     // private constructor used to duplicate the FileDescriptor (increase the reference count)
     explicit FileDescriptor(std::shared_ptr<FDWrapper> other_shared_ptr);
 
+    //! Read up to `size_to_read` bytes into `buffer` with a single [read(2)](\ref man2::read)
+    size_t read_into(char *buffer, const size_t size_to_read);
+
   protected:
     void register_read() { ++_internal_fd->_read_count; }    //!< increment read count
     void register_write() { ++_internal_fd->_write_count; }  //!< increment write count
@@ -61,6 +65,23 @@ class FileDescriptor {
     //! Read up to `limit` bytes into `str` (caller can allocate storage)
     void read(std::string &str, const size_t limit = std::numeric_limits<size_t>::max());
 
+    //! Read up to `limit` bytes into a recycled block from the BufferPool
+    Buffer read_buffer(const size_t limit = std::numeric_limits<size_t>::max());
+
+    //! Read up to `limit` bytes into recycled blocks from the BufferPool, with a single [readv(2)](\ref man2::readv),
+    //! and append them to `buffers`
+    size_t read(BufferList &buffers, const size_t limit = std::numeric_limits<size_t>::max());
+
+    //! Read into caller-supplied, possibly discontiguous storage with a single [readv(2)](\ref man2::readv)
+    size_t readv(const iovec *iov, const size_t iovcnt);
+
+    //! Account for a read of up to `size_to_read` bytes, which returned `bytes_read`, made on fd_num()
+    //! by other means (e.g., an io_uring), so that eof() and read_count() see it
+    void record_read(const size_t size_to_read, const size_t bytes_read);
+
+    //! Account for a write made on fd_num() by other means (e.g., an io_uring), so that write_count() sees it
+    void record_write() { register_write(); }
+
     //! Write a string, possibly blocking until all is written
     size_t write(const char *str, const bool write_all = true) { return write(BufferViewList(str), write_all); }
 
@@ -68,7 +89,17 @@ class FileDescriptor {
     size_t write(const std::string &str, const bool write_all = true) { return write(BufferViewList(str), write_all); }
 
     //! Write a buffer (or list of buffers), possibly blocking until all is written
-    size_t write(BufferViewList buffer, const bool write_all = true);
+    size_t write(const BufferViewList &buffer, const bool write_all = true);
+
+    //! Send `length` bytes of this file, from `offset`, to `destination` (e.g., a socket) with
+    //! [sendfile(2)](\ref man2::sendfile), possibly blocking until all is sent
+    size_t sendfile_to(FileDescriptor &destination,
+                       const off_t offset,
+                       const size_t length,
+                       const bool send_all = true);
+
+    //! Move up to `limit` bytes to `destination` with [splice(2)](\ref man2::splice); one of the two must be a pipe
+    size_t splice_to(FileDescriptor &destination, const size_t limit);
 
     //! Close the underlying file descriptor
     void close() { _internal_fd->close(); }
@@ -0,0 +1,178 @@
+#include "io_uring.hh"
+
+#include "util.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+//! Call [io_uring_setup(2)](\ref man2::io_uring_setup) and check that the kernel supports what IOUring needs
+static int setup(const unsigned entries, io_uring_params &params) {
+    const int fd = SystemCall("io_uring_setup", static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params)));
+
+    constexpr uint32_t required_features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required_features) != required_features) {
+        ::close(fd);
+        throw runtime_error("io_uring_setup: kernel lacks required io_uring features");
+    }
+    return fd;
+}
+
+//! Map part of an io_uring instance into memory
+static void *map_ring(const int fd, const size_t size, const off_t offset) {
+    void *const addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (addr == MAP_FAILED) {
+        throw unix_error("mmap");
+    }
+    return addr;
+}
+
+//! \param[in] entries is the number of operations that can be prepared between submissions
+IOUring::IOUring(const unsigned entries) : IOUring(entries, io_uring_params{}) {}
+
+//! \param[in] entries is the number of operations that can be prepared between submissions
+//! \param[in] params receives the queue sizes and offsets
+IOUring::IOUring(const unsigned entries, io_uring_params &&params)
+    : _ring(setup(entries, params))
+    , _rings_size(max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe)))
+    , _rings(map_ring(_ring.fd_num(), _rings_size, IORING_OFF_SQ_RING))
+    , _sqes_size(params.sq_entries * sizeof(io_uring_sqe))
+    , _sqes(static_cast<io_uring_sqe *>(map_ring(_ring.fd_num(), _sqes_size, IORING_OFF_SQES)))
+    , _sq_head(ring_field<unsigned>(params.sq_off.head))
+    , _sq_tail(ring_field<unsigned>(params.sq_off.tail))
+    , _sq_mask(*ring_field<unsigned>(params.sq_off.ring_mask))
+    , _sq_size(params.sq_entries)
+    , _cq_head(ring_field<unsigned>(params.cq_off.head))
+    , _cq_tail(ring_field<unsigned>(params.cq_off.tail))
+    , _cq_mask(*ring_field<unsigned>(params.cq_off.ring_mask))
+    , _cqes(ring_field<io_uring_cqe>(params.cq_off.cqes)) {
+    // submission queue entry i always lives in slot i of the SQE array
+    unsigned *const sq_array = ring_field<unsigned>(params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; ++i) {
+        sq_array[i] = i;
+    }
+}
+
+IOUring::~IOUring() {
+    if (::munmap(_sqes, _sqes_size) < 0 or ::munmap(_rings, _rings_size) < 0) {
+        // don't throw an exception from the destructor
+        cerr << "Exception destructing IOUring: " << strerror(errno) << endl;
+    }
+}
+
+//! \param[in] sqe is the operation to add to the submission queue
+void IOUring::push(const io_uring_sqe &sqe) {
+    const unsigned tail = *_sq_tail;
+    if (tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) == _sq_size) {
+        submit();
+    }
+
+    // the entry is published to the kernel by advancing the submission queue tail
+    _sqes[tail & _sq_mask] = sqe;
+    __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+//! \param[in] fd is the file descriptor to wait on
+//! \param[in] events are the [poll(2)](\ref man2::poll) events to wait for
+//! \param[in] user_data identifies the operation's Completion
+void IOUring::prepare_poll(const int fd, const short events, const uint64_t user_data) {
+    io_uring_sqe sqe{};
+    sqe.opcode = IORING_OP_POLL_ADD;
+    sqe.fd = fd;
+    sqe.poll32_events = static_cast<uint16_t>(events);
+    sqe.user_data = user_data;
+    push(sqe);
+}
+
+//! \param[in] target is the `user_data` of the poll to cancel
+//! \param[in] user_data identifies the operation's Completion
+void IOUring::prepare_poll_remove(const uint64_t target, const uint64_t user_data) {
+    io_uring_sqe sqe{};
+    sqe.opcode = IORING_OP_POLL_REMOVE;
+    sqe.fd = -1;
+    sqe.addr = target;
+    sqe.user_data = user_data;
+    push(sqe);
+}
+
+//! \param[in] fd is the file descriptor to read
+//! \param[in] buffer is where the bytes are stored
+//! \param[in] length is the maximum number of bytes to read
+//! \param[in] user_data identifies the operation's Completion
+void IOUring::prepare_read(const int fd, char *buffer, const size_t length, const uint64_t user_data) {
+    io_uring_sqe sqe{};
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(buffer);
+    sqe.len = static_cast<uint32_t>(min(length, size_t(numeric_limits<uint32_t>::max())));
+    sqe.off = static_cast<uint64_t>(-1);  // use (and advance) the file position, as read(2) does
+    sqe.user_data = user_data;
+    push(sqe);
+}
+
+//! \param[in] fd is the file descriptor to write
+//! \param[in] iov is the array of buffers to write
+//! \param[in] iovcnt is the number of buffers in `iov`
+//! \param[in] user_data identifies the operation's Completion
+void IOUring::prepare_writev(const int fd, const iovec *iov, const size_t iovcnt, const uint64_t user_data) {
+    io_uring_sqe sqe{};
+    sqe.opcode = IORING_OP_WRITEV;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(iov);
+    sqe.len = static_cast<uint32_t>(iovcnt);
+    sqe.off = static_cast<uint64_t>(-1);
+    sqe.user_data = user_data;
+    push(sqe);
+}
+
+//! \param[in] min_complete is the number of completions to wait for (0 to only submit)
+//! \param[in] timeout_ms is the longest time to wait, or -1 to wait indefinitely
+void IOUring::enter(const unsigned min_complete, const int timeout_ms) {
+    const unsigned to_submit = *_sq_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+
+    __kernel_timespec timeout{};
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+
+    io_uring_getevents_arg arg{};
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = timeout_ms < 0 ? 0 : reinterpret_cast<uint64_t>(&timeout);
+
+    const unsigned flags = IORING_ENTER_EXT_ARG | (min_complete > 0 ? IORING_ENTER_GETEVENTS : 0);
+    const long ret = ::syscall(__NR_io_uring_enter, _ring.fd_num(), to_submit, min_complete, flags, &arg, sizeof(arg));
+    if (ret < 0 and (errno == ETIME or errno == EBUSY)) {
+        // a timeout, or completions are waiting that did not fit in the completion queue
+        return;
+    }
+    SystemCall("io_uring_enter", static_cast<int>(ret));
+}
+
+//! \param[in] timeout_ms is the longest time to wait, or -1 to wait indefinitely
+//! \returns `false` if no operation completed before the timeout expired
+bool IOUring::submit_and_wait(const int timeout_ms) {
+    enter(1, timeout_ms);
+    return *_cq_head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+}
+
+std::optional<IOUring::Completion> IOUring::pop_completion() {
+    const unsigned head = *_cq_head;
+    if (head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) {
+        return {};
+    }
+
+    const io_uring_cqe &cqe = _cqes[head & _cq_mask];
+    const Completion completion{cqe.user_data, cqe.res};
+    __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+    return completion;
+}
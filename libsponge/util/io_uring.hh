@@ -0,0 +1,103 @@
+#ifndef SPONGE_LIBSPONGE_IO_URING_HH
+#define SPONGE_LIBSPONGE_IO_URING_HH
+
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <sys/uio.h>
+
+// from <linux/io_uring.h>, which is kept out of this header because it defines macros such as BLOCK_SIZE
+struct io_uring_params;
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+//! A minimal [io_uring(7)](\ref man7::io_uring) instance: prepare operations, then submit and reap them in batches
+class IOUring {
+  public:
+    //! The outcome of one completed operation
+    struct Completion {
+        uint64_t user_data;  //!< The value the operation was prepared with
+        int32_t result;      //!< The operation's return value, or -errno on failure
+    };
+
+  private:
+    FileDescriptor _ring;  //!< The io_uring instance
+
+    size_t _rings_size;   //!< Size of IOUring::_rings
+    void *_rings;         //!< Shared mapping of the submission and completion queues
+    size_t _sqes_size;    //!< Size of IOUring::_sqes
+    io_uring_sqe *_sqes;  //!< Shared mapping of the submission queue entries
+
+    unsigned *_sq_head;  //!< Next submission queue entry the kernel will consume
+    unsigned *_sq_tail;  //!< Next submission queue entry we will fill
+    unsigned _sq_mask;   //!< Index mask of the submission queue
+    unsigned _sq_size;   //!< Number of entries in the submission queue
+
+    unsigned *_cq_head;   //!< Next completion we will consume
+    unsigned *_cq_tail;   //!< Next completion the kernel will post
+    unsigned _cq_mask;    //!< Index mask of the completion queue
+    io_uring_cqe *_cqes;  //!< The completion queue entries
+
+    //! A field of the shared queues, at `offset` bytes into IOUring::_rings
+    template <typename T>
+    T *ring_field(const uint32_t offset) const {
+        return reinterpret_cast<T *>(static_cast<char *>(_rings) + offset);
+    }
+
+    //! Set up the io_uring; `params` is filled in by [io_uring_setup(2)](\ref man2::io_uring_setup)
+    IOUring(const unsigned entries, io_uring_params &&params);
+
+    //! Call [io_uring_enter(2)](\ref man2::io_uring_enter) to submit the prepared operations and wait for some
+    void enter(const unsigned min_complete, const int timeout_ms);
+
+    //! Add an operation to the submission queue, submitting the queue first if it is full
+    void push(const io_uring_sqe &sqe);
+
+  public:
+    //! Set up an io_uring with room for `entries` prepared operations; throws if the kernel lacks support
+    explicit IOUring(const unsigned entries = 256);
+
+    //! Unmap the queues; closing the ring cancels any operations still in flight
+    ~IOUring();
+
+    //! \name Preparing operations
+    //! The operations are not started until the next call to IOUring::submit or IOUring::submit_and_wait.
+    //! Any memory they refer to must stay valid until their Completion has been reaped.
+    //!@{
+
+    //! Wait until `fd` is ready for `events` (as in [poll(2)](\ref man2::poll)); the result is the revents
+    void prepare_poll(const int fd, const short events, const uint64_t user_data);
+
+    //! Cancel the poll that was prepared with `target`
+    void prepare_poll_remove(const uint64_t target, const uint64_t user_data);
+
+    //! Read up to `length` bytes from `fd` into `buffer`
+    void prepare_read(const int fd, char *buffer, const size_t length, const uint64_t user_data);
+
+    //! Write `iovcnt` buffers to `fd` with a single [writev(2)](\ref man2::writev)
+    void prepare_writev(const int fd, const iovec *iov, const size_t iovcnt, const uint64_t user_data);
+    //!@}
+
+    //! Start the prepared operations without waiting for any to complete
+    void submit() { enter(0, 0); }
+
+    //! Start the prepared operations and wait for at least one completion, with a single system call
+    bool submit_and_wait(const int timeout_ms);
+
+    //! Take the oldest unreaped Completion, if there is one
+    std::optional<Completion> pop_completion();
+
+    //! \name
+    //! An IOUring cannot be copied or moved
+
+    //!@{
+    IOUring(const IOUring &other) = delete;
+    IOUring &operator=(const IOUring &other) = delete;
+    IOUring(IOUring &&other) = delete;
+    IOUring &operator=(IOUring &&other) = delete;
+    //!@}
+};
+
+#endif  // SPONGE_LIBSPONGE_IO_URING_HH
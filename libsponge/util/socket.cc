@@ -2,7 +2,16 @@
 
 #include "util.hh"
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
 #include <cstddef>
+#include <cstring>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <poll.h>
 #include <stdexcept>
 #include <unistd.h>
 
@@ -84,26 +93,46 @@ void Socket::shutdown(const int how) {
     }
 }
 
+//! \param[in] message is a message filled in by [recvmsg(2)](\ref man2::recvmsg) or recvmmsg
+//! \param[in] payload_size is the number of bytes received
+//! \returns the size of the datagrams that the kernel coalesced into the payload, or `payload_size`
+static size_t received_segment_size(msghdr &message, const size_t payload_size) {
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP and cmsg->cmsg_type == UDP_GRO) {
+            int segment_size = 0;
+            memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+            return min(size_t(segment_size), payload_size);
+        }
+    }
+    return payload_size;
+}
+
 //! \note If `mtu` is too small to hold the received datagram, this method throws a std::runtime_error
 void UDPSocket::recv(received_datagram &datagram, const size_t mtu) {
-    // receive source address and payload
+    // receive source address, payload, and (if GRO is on) the size of the coalesced datagrams
     Address::Raw datagram_source_address;
+    ReceiveControl control;
     datagram.payload.resize(mtu);
 
-    socklen_t fromlen = sizeof(datagram_source_address);
+    iovec payload_iovec{datagram.payload.data(), datagram.payload.size()};
+    msghdr message{};
+    message.msg_name = &datagram_source_address.storage;
+    message.msg_namelen = sizeof(datagram_source_address.storage);
+    message.msg_iov = &payload_iovec;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data;
+    message.msg_controllen = sizeof(control.data);
 
-    const ssize_t recv_len = SystemCall(
-        "recvfrom",
-        ::recvfrom(
-            fd_num(), datagram.payload.data(), datagram.payload.size(), MSG_TRUNC, datagram_source_address, &fromlen));
+    const ssize_t recv_len = SystemCall("recvmsg", ::recvmsg(fd_num(), &message, MSG_TRUNC));
 
     if (recv_len > ssize_t(mtu)) {
-        throw runtime_error("recvfrom (oversized datagram)");
+        throw runtime_error("recvmsg (oversized datagram)");
     }
 
     register_read();
-    datagram.source_address = {datagram_source_address, fromlen};
+    datagram.source_address = {datagram_source_address, message.msg_namelen};
     datagram.payload.resize(recv_len);
+    datagram.segment_size = received_segment_size(message, recv_len);
 }
 
 UDPSocket::received_datagram UDPSocket::recv(const size_t mtu) {
@@ -112,6 +141,57 @@ UDPSocket::received_datagram UDPSocket::recv(const size_t mtu) {
     return ret;
 }
 
+//! \param[in,out] datagrams is the storage to receive into; each payload keeps its capacity from call to call
+//! \param[in] mtu is the largest datagram to accept
+//! \returns the number of datagrams received, at the front of `datagrams` (0 if a non-blocking socket had none)
+//! \details This waits for the first datagram (if the socket is blocking), then takes whatever else has
+//! already arrived, up to `datagrams.size()`, in the same system call. The kernel writes each datagram
+//! into the socket's own scratch space, `mtu` bytes apiece, and only the bytes received are copied
+//! into the payload, so a realistic `mtu` (rather than the 64 KiB default) keeps that space small.
+//! \note If `mtu` is too small to hold a received datagram, this method throws a std::runtime_error
+size_t UDPSocket::recv_batch(vector<received_datagram> &datagrams, const size_t mtu) {
+    const size_t batch = datagrams.size();
+    if (_batch.messages.size() < batch) {
+        _batch.messages.resize(batch);
+        _batch.iovecs.resize(batch);
+        _batch.sources.resize(batch);
+        _batch.controls.resize(batch);
+    }
+    if (_batch.payloads.size() < batch * mtu) {
+        _batch.payloads.resize(batch * mtu);
+    }
+
+    for (size_t i = 0; i < batch; ++i) {
+        _batch.iovecs[i] = {_batch.payloads.data() + i * mtu, mtu};
+        msghdr &message = _batch.messages[i].msg_hdr;
+        message = {};
+        message.msg_name = &_batch.sources[i].storage;
+        message.msg_namelen = sizeof(_batch.sources[i].storage);
+        message.msg_iov = &_batch.iovecs[i];
+        message.msg_iovlen = 1;
+        message.msg_control = _batch.controls[i].data;
+        message.msg_controllen = sizeof(_batch.controls[i].data);
+    }
+
+    const int count =
+        SystemCall("recvmmsg", ::recvmmsg(fd_num(), _batch.messages.data(), batch, MSG_WAITFORONE, nullptr), EAGAIN);
+    register_read();
+    if (count < 0) {
+        return 0;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        mmsghdr &message = _batch.messages[i];
+        if (message.msg_hdr.msg_flags & MSG_TRUNC) {
+            throw runtime_error("recvmmsg (oversized datagram)");
+        }
+        datagrams[i].source_address = {_batch.sources[i], message.msg_hdr.msg_namelen};
+        datagrams[i].payload.assign(_batch.payloads.data() + i * mtu, message.msg_len);
+        datagrams[i].segment_size = received_segment_size(message.msg_hdr, message.msg_len);
+    }
+    return count;
+}
+
 void sendmsg_helper(const int fd_num,
                     const sockaddr *destination_address,
                     const socklen_t destination_address_len,
@@ -141,6 +221,120 @@ void UDPSocket::send(const BufferViewList &payload) {
     register_write();
 }
 
+//! \param[in] destination is the Address to send every datagram to
+//! \param[in] payload is the data to send, as consecutive datagrams of `segment_size` bytes (the last may be shorter)
+//! \param[in] segment_size is the size of each datagram's payload
+//! \details Each [sendmsg(2)](\ref man2::sendmsg) hands the kernel as many datagrams as it takes at once
+//! (up to 64, and up to the largest IP packet), and the kernel (or the NIC) splits them up, so the
+//! datagrams cross the kernel boundary together rather than one by one. The receiver sees ordinary
+//! datagrams, whether or not it asks for them to be coalesced again with set_gro().
+void UDPSocket::sendto_segmented(const Address &destination,
+                                 const BufferViewList &payload,
+                                 const uint16_t segment_size) {
+    constexpr size_t MAX_SEGMENTS = 64;             // UDP_MAX_SEGMENTS in the kernel
+    constexpr size_t MAX_PAYLOAD = 65535 - 20 - 8;  // the largest IPv4 packet, less the IP and UDP headers
+    if (segment_size == 0 or segment_size > MAX_PAYLOAD) {
+        throw runtime_error("UDPSocket::sendto_segmented: invalid segment size");
+    }
+    const size_t max_send = segment_size * min(MAX_SEGMENTS, MAX_PAYLOAD / segment_size);
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(segment_size))]{};
+    auto next_view = payload.views().begin();
+    size_t next_offset = 0;  // bytes of `*next_view` already sent
+    size_t remaining = payload.size();
+
+    do {
+        // the iovecs for the next run of datagrams
+        _batch.iovecs.clear();
+        for (size_t wanted = min(remaining, max_send); wanted > 0;) {
+            const size_t length = min(next_view->size() - next_offset, wanted);
+            _batch.iovecs.push_back({const_cast<char *>(next_view->data()) + next_offset, length});
+            wanted -= length;
+            next_offset += length;
+            if (next_offset == next_view->size()) {
+                ++next_view;
+                next_offset = 0;
+            }
+        }
+
+        msghdr message{};
+        message.msg_name = const_cast<sockaddr *>(static_cast<const sockaddr *>(destination));
+        message.msg_namelen = destination.size();
+        message.msg_iov = _batch.iovecs.data();
+        message.msg_iovlen = _batch.iovecs.size();
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        cmsghdr *const cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(segment_size));
+        memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+
+        const size_t length = min(remaining, max_send);
+        if (size_t(SystemCall("sendmsg", ::sendmsg(fd_num(), &message, 0))) != length) {
+            throw runtime_error("sendmsg (segmented payload was not sent whole)");
+        }
+        remaining -= length;
+    } while (remaining > 0);
+
+    register_write();
+}
+
+//! \param[in] enabled turns coalescing on or off
+//! \details With GRO on, a received payload may hold several datagrams from the same sender, all of
+//! received_datagram::segment_size bytes except perhaps the last, so the receiver pays for one
+//! system call (and one trip up the network stack) per batch rather than per datagram. The mtu
+//! passed to recv() or recv_batch() must then leave room for a coalesced payload (up to 64 KiB).
+void UDPSocket::set_gro(const bool enabled) { setsockopt(SOL_UDP, UDP_GRO, int(enabled)); }
+
+//! \param[in] datagrams are sent in order, each to its own destination
+//! \returns the number of datagrams sent, from the front of `datagrams`
+//! \details If the kernel takes only some of the datagrams (e.g., because the socket's send buffer is
+//! full), the rest are sent by further calls to [sendmmsg(2)](\ref man2::sendmmsg). A blocking socket
+//! waits until every datagram is sent; a non-blocking one stops when the send buffer is full, and the
+//! caller should send the rest once the socket is writable.
+size_t UDPSocket::send_batch(const vector<outgoing_datagram> &datagrams) {
+    // gather every payload's iovecs first, so that the messages can point into a vector that no longer grows
+    _batch.iovecs.clear();
+    _batch.first_iovec.clear();
+    for (const auto &datagram : datagrams) {
+        _batch.first_iovec.push_back(_batch.iovecs.size());
+        for (const auto &view : datagram.payload.views()) {
+            _batch.iovecs.push_back({const_cast<char *>(view.data()), view.size()});
+        }
+    }
+    _batch.first_iovec.push_back(_batch.iovecs.size());
+
+    _batch.messages.resize(max(_batch.messages.size(), datagrams.size()));
+    for (size_t i = 0; i < datagrams.size(); ++i) {
+        const Address &destination = datagrams[i].destination;
+        msghdr &message = _batch.messages[i].msg_hdr;
+        message = {};
+        message.msg_name = const_cast<sockaddr *>(static_cast<const sockaddr *>(destination));
+        message.msg_namelen = destination.size();
+        message.msg_iov = _batch.iovecs.data() + _batch.first_iovec[i];
+        message.msg_iovlen = _batch.first_iovec[i + 1] - _batch.first_iovec[i];
+    }
+
+    size_t sent = 0;
+    while (sent < datagrams.size()) {
+        const int count = SystemCall(
+            "sendmmsg", ::sendmmsg(fd_num(), &_batch.messages[sent], datagrams.size() - sent, 0), EAGAIN);
+        if (count < 0) {
+            break;
+        }
+        for (size_t i = sent; i < sent + count; ++i) {
+            if (_batch.messages[i].msg_len != datagrams[i].payload.size()) {
+                throw runtime_error("datagram payload too big for sendmmsg()");
+            }
+        }
+        sent += count;
+    }
+    register_write();
+    return sent;
+}
+
 // mark the socket as listening for incoming connections
 //! \param[in] backlog is the number of waiting connections to queue (see [listen(2)](\ref man2::listen))
 void TCPSocket::listen(const int backlog) { SystemCall("listen", ::listen(fd_num(), backlog)); }
@@ -153,6 +347,232 @@ TCPSocket TCPSocket::accept() {
     return TCPSocket(FileDescriptor(SystemCall("accept", ::accept(fd_num(), nullptr, nullptr))));
 }
 
+// accept the connections that are waiting, without blocking
+//! \param[in] max is the most connections to accept
+//! \returns the accepted connections (possibly none), already non-blocking and close-on-exec
+//! \details Each connection costs one system call: accept4() sets the flags that accept() would
+//! need an fcntl() for, and the sockets skip the domain and type checks, since a TCP listener
+//! only ever accepts TCP sockets. Call this when the listening socket is readable (e.g., from an
+//! EventLoop rule) to take a whole burst of connections in one wakeup.
+//!
+//! A connection that failed while it waited (e.g., with ECONNABORTED or a network error) is skipped.
+//! A shortage of file descriptors or memory (or a signal) ends the batch early, rather than throwing
+//! away the connections already accepted; the rest stay queued for a later call.
+//! \note The listening socket should be non-blocking (see FileDescriptor::set_blocking); otherwise,
+//! this function blocks until `max` connections have been accepted.
+vector<TCPSocket> TCPSocket::accept_batch(const size_t max) {
+    register_read();
+
+    vector<TCPSocket> accepted{};
+    while (accepted.size() < max) {
+        const int fd = ::accept4(fd_num(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            switch (errno) {
+                case ECONNABORTED:  // the connection was reset while it waited
+                // network errors that were already pending on the new connection; as accept(2)
+                // advises, they say nothing about the listening socket, so just try again
+                case EPROTO:
+                case ENOPROTOOPT:
+                case ENETDOWN:
+                case EHOSTDOWN:
+                case EHOSTUNREACH:
+                case EOPNOTSUPP:
+                case ENETUNREACH:
+                    continue;  // move on to the next connection
+                case EAGAIN:   // no more waiting connections
+                case EINTR:
+                case EMFILE:
+                case ENFILE:
+                case ENOBUFS:
+                case ENOMEM:
+                    return accepted;
+                default:
+                    SystemCall("accept4", fd);
+            }
+        }
+        accepted.push_back(TCPSocket(FileDescriptor(fd), Unchecked{}));
+    }
+    return accepted;
+}
+
+//! \param[in] other is the socket to take over
+//! \returns this socket
+TCPSocket &TCPSocket::operator=(TCPSocket &&other) {
+    finish_zerocopy();
+    Socket::operator=(move(other));
+    _zerocopy = move(other._zerocopy);
+    return *this;
+}
+
+// send without copying the payload into the kernel
+//! \param[in] buffers are the bytes to send; the socket keeps a reference to them until the kernel is done
+//! \param[in] send_all keeps sending until all of `buffers` is sent (otherwise, sends once, and returns 0
+//!                     instead of throwing if a non-blocking socket is full)
+//! \returns the number of bytes sent
+//! \details The first call turns on [SO_ZEROCOPY](\ref man7::socket). Each send then pins the pages
+//! behind `buffers`, rather than copying them, so the caller must not change their contents; the
+//! refcounted storage is kept alive until the kernel reports (on the socket's error queue, which
+//! makes the socket poll as having an error) that it is done with it. Watch for that with an
+//! EventLoop rule, which must be added before the first send, and release the storage from it:
+//!
+//! ~~~{.cc}
+//! loop.add_rule(socket, Direction::Error, [&] { socket.reap_zerocopy(); });
+//! ~~~
+//!
+//! The socket keeps the buffers until the kernel reports that it is done with them, even if it is
+//! destroyed (or closed) before then: its destructor (or close()) waits for the completions with
+//! wait_zerocopy(). That wait lasts until the data is acknowledged by the peer (or copied for
+//! delivery over loopback), so call it where blocking is acceptable, or keep the socket around.
+//!
+//! Zerocopy only pays off for large sends (tens of KiB or more), since setting it up and reaping the
+//! completion costs more than copying a small payload. If the kernel runs out of memory for the
+//! completion notifications (see `optmem_max`), the data is sent by copying instead.
+size_t TCPSocket::send_zerocopy(const BufferList &buffers, const bool send_all) {
+    if (not _zerocopy) {
+        setsockopt(SOL_SOCKET, SO_ZEROCOPY, int(true));
+        _zerocopy = make_unique<ZeroCopyState>();
+    }
+
+    const BufferViewList views{buffers};
+    array<iovec, IOV_MAX> iovecs;
+    IovecCursor cursor{views, iovecs.data(), iovecs.size()};
+    size_t total_bytes_sent = 0;
+    LentBuffers *loan = nullptr;  // this call's entry in the lent buffers, once it has lent them
+    while (not cursor.done()) {
+        msghdr message{};
+        message.msg_iov = const_cast<iovec *>(cursor.iovecs());
+        message.msg_iovlen = cursor.count();
+
+        bool lent = true;
+        ssize_t bytes_sent = ::sendmsg(fd_num(), &message, MSG_ZEROCOPY);
+        if (bytes_sent < 0 and errno == ENOBUFS) {
+            lent = false;
+            bytes_sent = ::sendmsg(fd_num(), &message, 0);
+        }
+        if (SystemCall("sendmsg", bytes_sent, send_all ? 0 : EAGAIN) < 0) {
+            break;
+        }
+        if (bytes_sent == 0) {
+            throw runtime_error("sendmsg returned 0 given non-empty input buffer");
+        }
+
+        // the kernel numbers each zerocopy send that sent anything, and reports completions by number;
+        // all of a call's sends share one reference to its buffers
+        if (lent) {
+            if (loan == nullptr) {
+                _zerocopy->lent.push_back({_zerocopy->next_send, 0, 0, buffers});
+                loan = &_zerocopy->lent.back();
+            }
+            ++loan->sends;
+            ++_zerocopy->next_send;
+            ++_zerocopy->pending;
+        }
+
+        register_write();
+        cursor.advance(bytes_sent);
+        total_bytes_sent += bytes_sent;
+        if (not send_all) {
+            break;
+        }
+    }
+
+    return total_bytes_sent;
+}
+
+//! \returns the number of sends whose buffers were released
+//! \details Each completion notification covers a range of sends. The error queue is drained, so
+//! this counts as a read of the socket (as an EventLoop rule with Direction::Error requires).
+//! Once the queue is empty, the socket's own pending error (e.g., a reset), which would otherwise
+//! keep it polling as having an error, is cleared and thrown. It is looked up on every call, since
+//! an edge-triggered rule is not called again for an error that arrived with completions.
+size_t TCPSocket::reap_zerocopy() {
+    register_read();
+
+    size_t released = 0;
+    while (true) {
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_storage))];
+        msghdr message{};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (SystemCall("recvmsg", ::recvmsg(fd_num(), &message, MSG_ERRQUEUE), EAGAIN) < 0) {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            SystemCall("getsockopt", getsockopt(fd_num(), SOL_SOCKET, SO_ERROR, &error, &len));
+            if (error != 0) {
+                throw unix_error("TCPSocket::reap_zerocopy", error);
+            }
+            break;  // the error queue is empty
+        }
+
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if (not(cmsg->cmsg_level == SOL_IP and cmsg->cmsg_type == IP_RECVERR)) {
+                continue;
+            }
+            sock_extended_err error{};
+            memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+            if (error.ee_origin != SO_EE_ORIGIN_ZEROCOPY or error.ee_errno != 0 or not _zerocopy) {
+                continue;
+            }
+
+            // the sends numbered ee_info through ee_data (which may wrap around) are complete
+            const uint32_t first = error.ee_info;
+            const int64_t count = static_cast<int64_t>(static_cast<uint32_t>(error.ee_data - first)) + 1;
+            size_t completed = 0;
+            auto &lent = _zerocopy->lent;
+            for (auto &loan : lent) {
+                // the overlap of the loan's sends with the completed ones, numbered from `first`
+                const int64_t start = static_cast<int32_t>(loan.first_send - first);
+                const int64_t overlap = min(start + loan.sends, count) - max(start, int64_t(0));
+                if (overlap > 0) {
+                    loan.completed += overlap;
+                    completed += overlap;
+                }
+            }
+            lent.erase(
+                remove_if(lent.begin(), lent.end(), [](const auto &loan) { return loan.completed == loan.sends; }),
+                lent.end());
+
+            released += completed;
+            _zerocopy->pending -= completed;
+            if (error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                _zerocopy->copied += completed;
+            }
+        }
+    }
+    return released;
+}
+
+//! \details Waits in [poll(2)](\ref man2::poll) for the socket's error queue, and reaps completions
+//! as they arrive. A socket error is thrown, as by reap_zerocopy(); the sends that it cut short still
+//! complete, so a further call finishes the wait.
+void TCPSocket::wait_zerocopy() {
+    while (zerocopy_pending() > 0) {
+        pollfd descriptor{fd_num(), 0, 0};  // errors, and so completions, are always reported
+        SystemCall("poll", ::poll(&descriptor, 1, -1));
+        reap_zerocopy();
+    }
+}
+
+//! \details If the fd has been closed behind the socket's back (e.g., through a duplicate), the
+//! completions can no longer be read, so nothing will say when the kernel is done with the buffers;
+//! they are then kept for good, rather than returned to the BufferPool for reuse while still being sent.
+void TCPSocket::finish_zerocopy() noexcept {
+    if (zerocopy_pending() == 0) {
+        return;
+    }
+    if (closed()) {
+        static_cast<void>(_zerocopy.release());
+        return;
+    }
+    while (zerocopy_pending() > 0) {
+        try {
+            wait_zerocopy();
+        } catch (const exception &) {
+            // a socket error (or a signal) interrupted the wait, and the sends still complete
+        }
+    }
+}
+
 // set socket option
 //! \param[in] level The protocol level at which the argument resides
 //! \param[in] option A single option to set
@@ -166,3 +586,9 @@ void Socket::setsockopt(const int level, const int option, const option_type &op
 // allow local address to be reused sooner, at the cost of some robustness
 //! \note Using `SO_REUSEADDR` may reduce the robustness of your application
 void Socket::set_reuseaddr() { setsockopt(SOL_SOCKET, SO_REUSEADDR, int(true)); }
+
+// allow several sockets to bind the same address, with the kernel spreading the load across them
+//! \note Every socket bound to the address must set `SO_REUSEPORT` before binding, and all must belong
+//! to the same user. The kernel then assigns each new connection (or each datagram's flow) to one of
+//! them by a hash of its addresses and ports.
+void Socket::set_reuseport() { setsockopt(SOL_SOCKET, SO_REUSEPORT, int(true)); }
@@ -5,9 +5,12 @@
 #include "file_descriptor.hh"
 
 #include <cstdint>
+#include <deque>
 #include <functional>
+#include <memory>
 #include <string>
 #include <sys/socket.h>
+#include <vector>
 
 //! \brief Base class for network sockets (TCP, UDP, etc.)
 //! \details Socket is generally used via a subclass. See TCPSocket and UDPSocket for usage examples.
@@ -24,6 +27,12 @@ class Socket : public FileDescriptor {
     //! Construct from a file descriptor.
     Socket(FileDescriptor &&fd, const int domain, const int type);
 
+    //! Tag for constructing from a file descriptor whose domain and type are already known
+    struct Unchecked {};
+
+    //! Construct from a file descriptor without checking its domain and type
+    Socket(FileDescriptor &&fd, const Unchecked /* tag */) : FileDescriptor(std::move(fd)) {}
+
     //! Wrapper around [setsockopt(2)](\ref man2::setsockopt)
     template <typename option_type>
     void setsockopt(const int level, const int option, const option_type &option_value);
@@ -45,10 +54,32 @@ class Socket : public FileDescriptor {
 
     //! Allow local address to be reused sooner via [SO_REUSEADDR](\ref man7::socket)
     void set_reuseaddr();
+
+    //! Allow several sockets to bind the same local address via [SO_REUSEPORT](\ref man7::socket)
+    void set_reuseport();
 };
 
 //! A wrapper around [UDP sockets](\ref man7::udp)
 class UDPSocket : public Socket {
+  private:
+    //! Room for the ancillary data that a received datagram may carry (the UDP_GRO segment size)
+    struct ReceiveControl {
+        alignas(cmsghdr) char data[CMSG_SPACE(sizeof(int))];  //!< Filled in by the kernel
+    };
+
+    //! \brief The system call arguments of recv_batch(), send_batch() and sendto_segmented()
+    //! \details Each vector only grows, so a socket that keeps to a batch size (and mtu) stops allocating.
+    struct BatchScratch {
+        std::vector<mmsghdr> messages{};         //!< One per datagram
+        std::vector<iovec> iovecs{};             //!< The datagrams' payloads (or one run of segments)
+        std::vector<size_t> first_iovec{};       //!< Each outgoing datagram's first iovec, then the end
+        std::vector<Address::Raw> sources{};     //!< Source address of each received datagram
+        std::vector<ReceiveControl> controls{};  //!< Ancillary data of each received datagram
+        std::vector<char> payloads{};            //!< Received payloads, `mtu` bytes apart
+    };
+
+    BatchScratch _batch{};  //!< Storage reused by recv_batch(), send_batch() and sendto_segmented()
+
   protected:
     //! \brief Construct from FileDescriptor (used by TCPOverUDPSocketAdapter)
     //! \param[in] fd is the FileDescriptor from which to construct
@@ -60,8 +91,9 @@ class UDPSocket : public Socket {
 
     //! Returned by UDPSocket::recv; carries received data and information about the sender
     struct received_datagram {
-        Address source_address;  //!< Address from which this datagram was received
-        std::string payload;     //!< UDP datagram payload
+        Address source_address;   //!< Address from which this datagram was received
+        std::string payload;      //!< UDP datagram payload (several, if the kernel coalesced them; see set_gro())
+        size_t segment_size = 0;  //!< Size of each coalesced datagram (the last may be shorter), or of the payload
     };
 
     //! Receive a datagram and the Address of its sender
@@ -70,11 +102,29 @@ class UDPSocket : public Socket {
     //! Receive a datagram and the Address of its sender (caller can allocate storage)
     void recv(received_datagram &datagram, const size_t mtu = 65536);
 
+    //! Receive up to `datagrams.size()` datagrams with one [recvmmsg(2)](\ref man2::recvmmsg), reusing their storage
+    size_t recv_batch(std::vector<received_datagram> &datagrams, const size_t mtu = 65536);
+
+    //! A datagram for UDPSocket::send_batch; carries the data and the Address to send it to
+    struct outgoing_datagram {
+        Address destination;     //!< Address to which this datagram is sent
+        BufferViewList payload;  //!< UDP datagram payload
+    };
+
+    //! Send several datagrams with [sendmmsg(2)](\ref man2::sendmmsg), returning how many the kernel took
+    size_t send_batch(const std::vector<outgoing_datagram> &datagrams);
+
     //! Send a datagram to specified Address
     void sendto(const Address &destination, const BufferViewList &payload);
 
     //! Send datagram to the socket's connected address (must call connect() first)
     void send(const BufferViewList &payload);
+
+    //! Send `payload` as datagrams of `segment_size` bytes, split up by the kernel ([UDP_SEGMENT](\ref man7::udp))
+    void sendto_segmented(const Address &destination, const BufferViewList &payload, const uint16_t segment_size);
+
+    //! Let the kernel coalesce received datagrams from one flow into one payload ([UDP_GRO](\ref man7::udp))
+    void set_gro(const bool enabled);
 };
 
 //! \class UDPSocket
@@ -87,19 +137,80 @@ class UDPSocket : public Socket {
 //! A wrapper around [TCP sockets](\ref man7::tcp)
 class TCPSocket : public Socket {
   private:
+    //! \brief The buffers of one send_zerocopy() call, lent to the kernel for one or more sends
+    struct LentBuffers {
+        uint32_t first_send;  //!< The kernel's number for the call's first zerocopy send
+        uint32_t sends;       //!< Number of zerocopy sends the call made
+        uint32_t completed;   //!< Number of those sends that the kernel has completed
+        BufferList buffers;   //!< The call's buffers
+    };
+
+    //! \brief Buffers lent to the kernel by send_zerocopy(), kept alive until the kernel is done with them
+    struct ZeroCopyState {
+        uint32_t next_send = 0;          //!< The number the kernel gives the next zerocopy send
+        std::deque<LentBuffers> lent{};  //!< The buffers of each call with uncompleted sends, in order
+        size_t pending = 0;              //!< Number of uncompleted sends
+        size_t copied = 0;               //!< Completed sends for which the kernel copied the data after all
+    };
+
+    std::unique_ptr<ZeroCopyState> _zerocopy{};  //!< Set up by the first send_zerocopy()
+
+    //! Wait for the zerocopy sends in flight, if any, without throwing (see ~TCPSocket())
+    void finish_zerocopy() noexcept;
+
     //! \brief Construct from FileDescriptor (used by accept())
     //! \param[in] fd is the FileDescriptor from which to construct
     explicit TCPSocket(FileDescriptor &&fd) : Socket(std::move(fd), AF_INET, SOCK_STREAM) {}
 
+    //! \brief Construct from a FileDescriptor that is known to be a TCP socket (used by accept_batch())
+    //! \param[in] fd is the FileDescriptor from which to construct
+    TCPSocket(FileDescriptor &&fd, const Unchecked tag) : Socket(std::move(fd), tag) {}
+
   public:
     //! Default: construct an unbound, unconnected TCP socket
     TCPSocket() : Socket(AF_INET, SOCK_STREAM) {}
 
+    //! Wait until the kernel is done with the buffers of any zerocopy sends in flight
+    ~TCPSocket() { finish_zerocopy(); }
+
+    //! \name Move constructor/assignment operator
+    //! A TCPSocket that is assigned to first waits for its zerocopy sends in flight
+    //!@{
+    TCPSocket(TCPSocket &&other) noexcept = default;
+    TCPSocket &operator=(TCPSocket &&other);
+    //!@}
+
+    //! Wait for any zerocopy sends in flight (see wait_zerocopy()), then close the socket
+    void close() {
+        wait_zerocopy();
+        Socket::close();
+    }
+
     //! Mark a socket as listening for incoming connections
     void listen(const int backlog = 16);
 
     //! Accept a new incoming connection
     TCPSocket accept();
+
+    //! Accept up to `max` waiting connections as non-blocking sockets, with [accept4(2)](\ref man2::accept)
+    std::vector<TCPSocket> accept_batch(const size_t max = 64);
+
+    //! Send `buffers` without copying them ([MSG_ZEROCOPY](\ref man7::socket)), keeping them alive until
+    //! the kernel is done with them; possibly blocks until all is sent
+    size_t send_zerocopy(const BufferList &buffers, const bool send_all = true);
+
+    //! Release the buffers of the zerocopy sends that the kernel has completed, per the socket's error queue,
+    //! and throw the socket's pending error, if it has one
+    size_t reap_zerocopy();
+
+    //! Block until the kernel is done with the buffers of every zerocopy send
+    void wait_zerocopy();
+
+    //! Number of zerocopy sends whose buffers the kernel may still be using
+    size_t zerocopy_pending() const { return _zerocopy ? _zerocopy->pending : 0; }
+
+    //! Number of completed zerocopy sends for which the kernel copied the data after all (e.g., over loopback)
+    size_t zerocopy_copied() const { return _zerocopy ? _zerocopy->copied : 0; }
 };
 
 //! \class TCPSocket
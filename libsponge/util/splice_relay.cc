@@ -0,0 +1,71 @@
+#include "splice_relay.hh"
+
+#include "util.hh"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace std;
+
+//! A non-blocking, close-on-exec pipe as a (read end, write end) pair of FileDescriptors
+static pair<FileDescriptor, FileDescriptor> make_pipe() {
+    int fds[2];
+    SystemCall("pipe2", ::pipe2(fds, O_NONBLOCK | O_CLOEXEC));
+    return {FileDescriptor(fds[0]), FileDescriptor(fds[1])};
+}
+
+//! \returns `true` if `fd` has room to write, without waiting
+static bool writable(const FileDescriptor &fd) {
+    pollfd descriptor{fd.fd_num(), POLLOUT, 0};
+    SystemCall("poll", ::poll(&descriptor, 1, 0));
+    return descriptor.revents & POLLOUT;
+}
+
+//! \param[in] capacity is the least the pipe should hold; larger pipes let each splice move more
+SpliceRelay::SpliceRelay(const size_t capacity) : SpliceRelay(make_pipe(), capacity) {}
+
+//! \param[in] pipe is the relay's pipe, as a (read end, write end) pair
+//! \param[in] capacity is as for the public constructor
+SpliceRelay::SpliceRelay(pair<FileDescriptor, FileDescriptor> &&pipe, const size_t capacity)
+    : _pipe_read(move(pipe.first)), _pipe_write(move(pipe.second)), _capacity(0) {
+    if (capacity > 0) {
+        SystemCall("fcntl", ::fcntl(_pipe_write.fd_num(), F_SETPIPE_SZ, static_cast<int>(capacity)));
+    }
+    _capacity = SystemCall("fcntl", ::fcntl(_pipe_write.fd_num(), F_GETPIPE_SZ));
+}
+
+//! \param[in] source is where the bytes come from (e.g., a socket or a file)
+//! \param[in] limit is the most bytes to move
+//! \returns the number of bytes moved, which is 0 if the pipe is full, if a non-blocking `source` has
+//!          nothing to read, or at EOF (when `source.eof()` is then `true`)
+size_t SpliceRelay::fill(FileDescriptor &source, const size_t limit) {
+    if (full()) {
+        return 0;
+    }
+    const size_t bytes_moved = source.splice_to(_pipe_write, min(limit, _capacity - _buffered));
+    _buffered += bytes_moved;
+
+    // a pipe holds a number of pages, not bytes, so it can fill up early; wait for drain() to make room
+    // (but if the pipe still has room, it was a non-blocking `source` that had nothing to read)
+    if (bytes_moved == 0 and _buffered > 0 and not source.eof() and not writable(_pipe_write)) {
+        _stalled = true;
+    }
+    return bytes_moved;
+}
+
+//! \param[in] destination is where the bytes go (e.g., a socket)
+//! \returns the number of bytes moved, which is 0 if the pipe is empty or a non-blocking `destination` is full
+size_t SpliceRelay::drain(FileDescriptor &destination) {
+    if (empty()) {
+        return 0;
+    }
+    const size_t bytes_moved = _pipe_read.splice_to(destination, _buffered);
+    _buffered -= bytes_moved;
+    if (bytes_moved > 0) {
+        _stalled = false;
+    }
+    return bytes_moved;
+}
@@ -0,0 +1,55 @@
+#ifndef SPONGE_LIBSPONGE_SPLICE_RELAY_HH
+#define SPONGE_LIBSPONGE_SPLICE_RELAY_HH
+
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <limits>
+#include <utility>
+
+//! \brief Relays bytes from one FileDescriptor to another through a kernel pipe, without copying them to user space.
+
+//! [splice(2)](\ref man2::splice) moves bytes between a pipe and any other fd inside the kernel.
+//! A SpliceRelay owns a pipe, and moves bytes from a source (e.g., the client side of a proxied
+//! connection) into it with fill(), and from it to a destination with drain(). The pipe is
+//! non-blocking, so neither call blocks on it; they block only if the source or destination does.
+//! In an EventLoop, each direction of a proxy is a pair of rules:
+//!
+//! ~~~{.cc}
+//! loop.add_rule(client, Direction::In, [&] { relay.fill(client); }, [&] { return not relay.full(); });
+//! loop.add_rule(server, Direction::Out, [&] { relay.drain(server); }, [&] { return not relay.empty(); });
+//! ~~~
+class SpliceRelay {
+    FileDescriptor _pipe_read;   //!< The read end of the pipe
+    FileDescriptor _pipe_write;  //!< The write end of the pipe
+    size_t _capacity;            //!< How many bytes the pipe holds
+    size_t _buffered = 0;        //!< How many bytes are in the pipe
+    bool _stalled = false;       //!< The pipe filled up before `_capacity` (its pages are partly used)
+
+    //! Construct from a pipe, as a (read end, write end) pair
+    SpliceRelay(std::pair<FileDescriptor, FileDescriptor> &&pipe, const size_t capacity);
+
+  public:
+    //! Construct a relay whose pipe holds at least `capacity` bytes (0 for the system's default)
+    explicit SpliceRelay(const size_t capacity = 0);
+
+    //! Move up to `limit` bytes from `source` into the pipe (as many as fit)
+    size_t fill(FileDescriptor &source, const size_t limit = std::numeric_limits<size_t>::max());
+
+    //! Move bytes from the pipe to `destination` (as many as it takes)
+    size_t drain(FileDescriptor &destination);
+
+    //! Number of bytes in the pipe
+    size_t buffered() const { return _buffered; }
+
+    //! How many bytes the pipe holds
+    size_t capacity() const { return _capacity; }
+
+    //! \returns `true` if the pipe is empty
+    bool empty() const { return _buffered == 0; }
+
+    //! \returns `true` if the pipe is full
+    bool full() const { return _stalled or _buffered >= _capacity; }
+};
+
+#endif  // SPONGE_LIBSPONGE_SPLICE_RELAY_HH
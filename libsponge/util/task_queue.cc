@@ -0,0 +1,78 @@
+#include "task_queue.hh"
+
+#include "util.hh"
+
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace std;
+
+TaskQueue::TaskQueue()
+    : _head(new Node), _tail(_head.load()), _event(SystemCall("eventfd", eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))) {}
+
+TaskQueue::~TaskQueue() {
+    while (_tail != nullptr) {
+        Node *const next = _tail->next.load();
+        delete _tail;
+        _tail = next;
+    }
+}
+
+//! \details The eventfd is written directly, rather than via FileDescriptor::write, so that the
+//! FileDescriptor's counters (which EventLoop checks for busy waits) are only touched by the consumer.
+void TaskQueue::signal() {
+    if (not _signaled.exchange(true)) {
+        const uint64_t one = 1;
+        SystemCall("write", static_cast<int>(::write(_event.fd_num(), &one, sizeof(one))));
+    }
+}
+
+//! \param[in] task is the task to run on the consumer thread
+void TaskQueue::push(TaskT task) {
+    Node *const node = new Node;
+    node->task = move(task);
+
+    // claim a place in the queue, then make the node reachable from its predecessor
+    Node *const previous = _head.exchange(node);
+    previous->next.store(node, memory_order_release);
+
+    signal();
+}
+
+//! \returns the number of tasks that ran
+//! \details Tasks that are pushed while the queue runs (e.g., by the tasks themselves) are left
+//! for the next call, so that one busy queue cannot starve the rest of the consumer's EventLoop.
+size_t TaskQueue::run_pending() {
+    // consume the wakeup before looking at the queue, so that any task pushed from now on signals again
+    _event.read(sizeof(uint64_t));
+    _signaled.store(false);
+
+    Node *const last = _head.load();
+    size_t count = 0;
+    while (_tail != last) {
+        Node *const next = _tail->next.load(memory_order_acquire);
+        if (next == nullptr) {
+            break;  // the producer of `next` has not linked it yet, and will signal once it has
+        }
+
+        delete _tail;
+        _tail = next;
+        const TaskT task = move(next->task);
+        next->task = nullptr;
+        ++count;
+        try {
+            task();
+        } catch (...) {
+            signal();  // the wakeup was consumed, and the remaining tasks still have to run
+            throw;
+        }
+    }
+
+    // if tasks were left for next time, make sure there will be a next time
+    if (_tail != _head.load()) {
+        signal();
+    }
+    return count;
+}
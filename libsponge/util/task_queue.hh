@@ -0,0 +1,75 @@
+#ifndef SPONGE_LIBSPONGE_TASK_QUEUE_HH
+#define SPONGE_LIBSPONGE_TASK_QUEUE_HH
+
+#include "file_descriptor.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+
+//! \brief A lock-free queue of tasks that any thread may push, run by a single consumer thread.
+
+//! TaskQueue is an intrusive multi-producer, single-consumer linked queue: a producer
+//! claims its place with one atomic exchange on the head and then links its node behind
+//! its predecessor, and the consumer follows the links from the tail without any atomic
+//! read-modify-write. Tasks from the same producer run in the order they were pushed.
+//!
+//! The consumer is woken through an [eventfd(2)](\ref man2::eventfd), event(), which is
+//! signaled only when the queue goes from "nothing to run" to "something to run", so a
+//! burst of pushes costs one system call. The eventfd is meant to be watched by an
+//! EventLoop running on the consumer thread:
+//!
+//! ~~~{.cc}
+//! loop.add_rule(queue.event(), Direction::In, [&] { queue.run_pending(); });
+//! ~~~
+class TaskQueue {
+  public:
+    using TaskT = std::function<void(void)>;  //!< A unit of work
+
+  private:
+    //! Size of a cache line, used to keep the producers' and the consumer's state apart
+    static constexpr size_t CACHE_LINE = 64;
+
+    //! \brief A queued task
+    struct Node {
+        std::atomic<Node *> next{nullptr};  //!< The node pushed after this one, once it is linked
+        TaskT task{};                       //!< The task (empty for the node at the tail)
+    };
+
+    alignas(CACHE_LINE) std::atomic<Node *> _head;           //!< The most recently pushed node (written by producers)
+    alignas(CACHE_LINE) Node *_tail;                         //!< The node whose task last ran (consumer only)
+    alignas(CACHE_LINE) std::atomic<bool> _signaled{false};  //!< event() has been signaled since the last run
+
+    FileDescriptor _event;  //!< eventfd signaled to wake the consumer
+
+    //! Wake the consumer, unless it has already been woken and has not yet run the queue
+    void signal();
+
+  public:
+    //! Construct an empty queue
+    TaskQueue();
+
+    //! Destroy any tasks that have not run
+    ~TaskQueue();
+
+    //! Queue a task (from any thread)
+    void push(TaskT task);
+
+    //! Run the tasks that were queued before the call (from the consumer thread, when event() is readable)
+    size_t run_pending();
+
+    //! An eventfd that becomes readable when there are tasks to run
+    const FileDescriptor &event() const { return _event; }
+
+    //! \name
+    //! A TaskQueue cannot be copied or moved
+
+    //!@{
+    TaskQueue(const TaskQueue &other) = delete;
+    TaskQueue &operator=(const TaskQueue &other) = delete;
+    TaskQueue(TaskQueue &&other) = delete;
+    TaskQueue &operator=(TaskQueue &&other) = delete;
+    //!@}
+};
+
+#endif  // SPONGE_LIBSPONGE_TASK_QUEUE_HH
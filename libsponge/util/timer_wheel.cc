@@ -0,0 +1,226 @@
+#include "timer_wheel.hh"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+//! \param[in] now_ms is the current time, in ms (e.g., from timestamp_ms())
+TimerWheel::TimerWheel(const uint64_t now_ms) : _heads(), _current(now_ms) { _heads.fill(NIL); }
+
+//! \param[in] index is the timer to file
+void TimerWheel::link(const uint32_t index) {
+    Timer &timer = _timers[index];
+    const uint64_t deadline = max(timer.deadline, _current);
+    const uint64_t difference = deadline ^ _current;
+
+    // the lowest level above which the deadline and the current time agree
+    unsigned level = 0;
+    while (level < LEVELS - 1 and (difference >> (SLOT_BITS * (level + 1))) != 0) {
+        ++level;
+    }
+
+    // the top level wraps around: its slots behind the current one are in its next rotation
+    unsigned slot_in_level = (deadline >> (SLOT_BITS * level)) % SLOTS;
+    const unsigned top_shift = SLOT_BITS * (LEVELS - 1);
+    if (level == LEVELS - 1 and (deadline >> top_shift) - (_current >> top_shift) >= SLOTS) {
+        // beyond the span of the wheel: wait in the top level's furthest slot, then be filed again
+        slot_in_level = ((_current >> top_shift) + SLOTS - 1) % SLOTS;
+    }
+
+    const uint32_t slot = level * SLOTS + slot_in_level;
+    timer.slot = slot;
+    timer.prev = NIL;
+    timer.next = _heads[slot];
+    if (timer.next != NIL) {
+        _timers[timer.next].prev = index;
+    }
+    _heads[slot] = index;
+    _occupied[level][slot_in_level / 64] |= uint64_t(1) << (slot_in_level % 64);
+}
+
+//! \param[in] index is the timer to take out of its slot
+void TimerWheel::unlink(const uint32_t index) {
+    Timer &timer = _timers[index];
+    if (timer.prev != NIL) {
+        _timers[timer.prev].next = timer.next;
+    } else {
+        _heads[timer.slot] = timer.next;
+    }
+    if (timer.next != NIL) {
+        _timers[timer.next].prev = timer.prev;
+    }
+
+    if (_heads[timer.slot] == NIL) {
+        const unsigned level = timer.slot / SLOTS, slot_in_level = timer.slot % SLOTS;
+        _occupied[level][slot_in_level / 64] &= ~(uint64_t(1) << (slot_in_level % 64));
+    }
+}
+
+//! \param[in] index is the timer to free
+void TimerWheel::release(const uint32_t index) {
+    Timer &timer = _timers[index];
+    timer.callback = nullptr;
+    timer.generation = timer.generation == UINT32_MAX ? 1 : timer.generation + 1;
+    timer.slot = NIL;
+    timer.next = _free;
+    _free = index;
+    --_size;
+}
+
+//! \param[in] level is the level whose current slot is emptied into the levels below it
+void TimerWheel::cascade(const unsigned level) {
+    const unsigned slot_in_level = (_current >> (SLOT_BITS * level)) % SLOTS;
+    uint32_t index = _heads[level * SLOTS + slot_in_level];
+    _heads[level * SLOTS + slot_in_level] = NIL;
+    _occupied[level][slot_in_level / 64] &= ~(uint64_t(1) << (slot_in_level % 64));
+
+    while (index != NIL) {
+        const uint32_t next = _timers[index].next;
+        link(index);
+        index = next;
+    }
+}
+
+//! \param[in] level is the level to search
+//! \param[in] slot is the first slot to consider (may be SLOTS)
+unsigned TimerWheel::next_occupied(const unsigned level, const unsigned slot) const {
+    for (unsigned word = slot / 64; word < SLOTS / 64; ++word) {
+        uint64_t bits = _occupied[level][word];
+        if (word == slot / 64) {
+            bits &= ~uint64_t(0) << (slot % 64);
+        }
+        if (bits != 0) {
+            return word * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return SLOTS;
+}
+
+//! \param[in] deadline_ms is when the timer expires; a deadline that has already passed expires on the next call
+//! \param[in] callback is called when the timer expires
+//! \returns an id that can be passed to TimerWheel::cancel
+TimerWheel::TimerId TimerWheel::add(const uint64_t deadline_ms, const CallbackT &callback) {
+    uint32_t index = _free;
+    if (index != NIL) {
+        _free = _timers[index].next;
+    } else {
+        if (_timers.size() >= NIL) {
+            throw runtime_error("TimerWheel: too many timers");
+        }
+        index = static_cast<uint32_t>(_timers.size());
+        _timers.emplace_back();
+    }
+
+    Timer &timer = _timers[index];
+    timer.deadline = deadline_ms;
+    timer.callback = callback;
+    link(index);
+    ++_size;
+    return (TimerId(timer.generation) << 32) | index;
+}
+
+//! \param[in] id was returned by TimerWheel::add
+bool TimerWheel::cancel(const TimerId id) {
+    const auto index = static_cast<uint32_t>(id);
+    if (index >= _timers.size() or _timers[index].generation != (id >> 32) or _timers[index].slot == NIL) {
+        return false;
+    }
+
+    // a timer in the batch being expired has already been taken out of its slot
+    if (_timers[index].slot != EXPIRING) {
+        unlink(index);
+    }
+    release(index);
+    return true;
+}
+
+//! \details The result is the earliest of, at each level, the start of the next occupied slot
+//! (including the current one, if the wheel is at its start and it has not been cascaded yet).
+//! It is exact for timers in level 0, and otherwise is when the wheel next has to move timers down
+//! from a higher level.
+std::optional<uint64_t> TimerWheel::next_deadline() const {
+    optional<uint64_t> ret{};
+
+    for (unsigned level = 0; level < LEVELS; ++level) {
+        const unsigned shift = SLOT_BITS * level;
+        const unsigned current_slot = (_current >> shift) % SLOTS;
+        const uint64_t rotation_start = (_current >> (shift + SLOT_BITS)) << (shift + SLOT_BITS);
+
+        // a level's current slot is yet to be processed only if the wheel is at its start (always, for level 0)
+        const bool at_slot_start = _current % (uint64_t(1) << shift) == 0;
+        const unsigned slot = next_occupied(level, at_slot_start ? current_slot : current_slot + 1);
+
+        optional<uint64_t> candidate{};
+        if (slot < SLOTS) {
+            candidate = rotation_start + (uint64_t(slot) << shift);
+        } else if (level == LEVELS - 1) {
+            // the top level's slots behind the current one are in its next rotation
+            const unsigned wrapped_slot = next_occupied(level, 0);
+            if (wrapped_slot < SLOTS) {
+                candidate = rotation_start + (uint64_t(1) << (shift + SLOT_BITS)) + (uint64_t(wrapped_slot) << shift);
+            }
+        }
+
+        if (candidate.has_value() and (not ret.has_value() or candidate.value() < ret.value())) {
+            ret = candidate;
+        }
+    }
+    return ret;
+}
+
+//! \param[in] now_ms is the current time, in ms
+//! \returns the number of timers that expired
+size_t TimerWheel::expire(const uint64_t now_ms) {
+    size_t expired = 0;
+
+    // reuse the batch's storage, but allow a callback to call expire() itself
+    vector<TimerId> batch{};
+    batch.swap(_batch);
+
+    while (_current <= now_ms) {
+        // jump over ticks at which nothing happens; since next_deadline() counts the start of every
+        // occupied slot at every level, each slot boundary that the jump passes over is empty and
+        // needs no cascading
+        const auto next = next_deadline();
+        if (not next.has_value() or next.value() > now_ms) {
+            _current = now_ms + 1;
+            break;
+        }
+        _current = next.value();
+
+        // when a level's slot is reached, its timers move down (from the highest level first, since
+        // its timers may land in the slot of a lower level that starts at the same tick)
+        for (unsigned level = LEVELS - 1; level > 0; --level) {
+            if (_current % (uint64_t(1) << (SLOT_BITS * level)) == 0) {
+                cascade(level);
+            }
+        }
+
+        // take the due timers out before calling back, since callbacks may add timers to the same slot
+        const unsigned slot = _current % SLOTS;
+        for (uint32_t index = _heads[slot]; index != NIL; index = _timers[index].next) {
+            _timers[index].slot = EXPIRING;
+            batch.push_back((TimerId(_timers[index].generation) << 32) | index);
+        }
+        _heads[slot] = NIL;
+        _occupied[0][slot / 64] &= ~(uint64_t(1) << (slot % 64));
+        ++_current;
+
+        for (const TimerId id : batch) {
+            const auto index = static_cast<uint32_t>(id);
+            if (_timers[index].generation != (id >> 32)) {
+                continue;  // canceled by an earlier callback
+            }
+            const CallbackT callback = move(_timers[index].callback);
+            release(index);
+            ++expired;
+            callback();
+        }
+        batch.clear();
+    }
+
+    _batch.swap(batch);
+    return expired;
+}
@@ -0,0 +1,93 @@
+#ifndef SPONGE_LIBSPONGE_TIMER_WHEEL_HH
+#define SPONGE_LIBSPONGE_TIMER_WHEEL_HH
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+//! A hierarchical timing wheel with millisecond ticks: timers are added and canceled in O(1)
+class TimerWheel {
+  public:
+    using TimerId = uint64_t;                     //!< Identifies a timer; never 0
+    using CallbackT = std::function<void(void)>;  //!< Called when a timer expires
+
+    static constexpr unsigned SLOT_BITS = 8;            //!< log2 of the number of slots per level
+    static constexpr unsigned SLOTS = 1u << SLOT_BITS;  //!< Number of slots per level
+    static constexpr unsigned LEVELS = 4;               //!< Number of levels; together they span 2^32 ms
+
+  private:
+    static constexpr uint32_t NIL = UINT32_MAX;           //!< Marks the end of a slot's list
+    static constexpr uint32_t EXPIRING = UINT32_MAX - 1;  //!< Timer::slot of a timer that is being expired
+
+    //! \brief A timer, linked into the list of the slot it waits in
+    struct Timer {
+        uint64_t deadline = 0;    //!< When the timer expires, in ms
+        CallbackT callback{};     //!< Called when the timer expires
+        uint32_t generation = 1;  //!< Incremented whenever this node is freed, to invalidate old TimerIds
+        uint32_t slot = NIL;      //!< Index into TimerWheel::_heads of the timer's slot, EXPIRING, or NIL if free
+        uint32_t prev = NIL;      //!< Previous timer in the slot
+        uint32_t next = NIL;      //!< Next timer in the slot (or in the free list)
+    };
+
+    std::vector<Timer> _timers{};                 //!< All timer nodes, active or free
+    uint32_t _free = NIL;                         //!< Head of the list of free nodes
+    size_t _size = 0;                             //!< Number of active timers
+    std::array<uint32_t, LEVELS * SLOTS> _heads;  //!< First timer in each slot of each level
+
+    //! One bit per slot of each level, set if the slot is not empty
+    std::array<std::array<uint64_t, SLOTS / 64>, LEVELS> _occupied{};
+
+    uint64_t _current;  //!< The next tick to be processed; every earlier deadline has expired
+
+    std::vector<TimerId> _batch{};  //!< Storage for the timers being expired, kept to avoid reallocating
+
+    //! Put an unlinked timer in the slot for its deadline
+    void link(const uint32_t index);
+
+    //! Take a timer out of its slot
+    void unlink(const uint32_t index);
+
+    //! Return a node to the free list, invalidating its TimerId
+    void release(const uint32_t index);
+
+    //! Re-file the timers in the current slot of `level`, which the wheel has just reached
+    void cascade(const unsigned level);
+
+    //! Index of the first occupied slot of `level` at or after `slot`, or SLOTS if there is none
+    unsigned next_occupied(const unsigned level, const unsigned slot) const;
+
+  public:
+    //! Construct an empty wheel whose first tick is `now_ms`
+    explicit TimerWheel(const uint64_t now_ms);
+
+    //! Call `callback` from the first call to TimerWheel::expire at or after `deadline_ms`
+    TimerId add(const uint64_t deadline_ms, const CallbackT &callback);
+
+    //! Cancel a timer; returns `false` if it has already expired or been canceled
+    bool cancel(const TimerId id);
+
+    //! A time no later than the earliest deadline, or nothing if there are no timers
+    std::optional<uint64_t> next_deadline() const;
+
+    //! Call back every timer whose deadline is at or before `now_ms`, in deadline order; returns how many
+    size_t expire(const uint64_t now_ms);
+
+    //! Number of timers that have been added and have not expired or been canceled
+    size_t size() const { return _size; }
+
+    //! Whether there are no timers
+    bool empty() const { return _size == 0; }
+};
+
+//! \class TimerWheel
+//! Level 0 has one slot per millisecond; each slot of level `n` spans all of level `n - 1`.
+//! A timer is filed at the lowest level at which its deadline and the current time differ
+//! only in that level's slot (and lower bits), so each timer is moved down at most
+//! LEVELS - 1 times, when the wheel reaches its slot, before it expires from level 0.
+//! The top level instead wraps around, and deadlines beyond its span are filed in its furthest
+//! slot and re-filed from there.
+
+#endif  // SPONGE_LIBSPONGE_TIMER_WHEEL_HH
@@ -18,6 +18,16 @@ uint64_t timestamp_ms() {
     return std::chrono::duration_cast<std::chrono::milliseconds>(now - program_start).count();
 }
 
+//! \param[in] n is the number to round up
+//! \returns the smallest power of two no less than `n` (1, if `n` is 0)
+size_t next_power_of_two(const size_t n) {
+    size_t ret = 1;
+    while (ret < n) {
+        ret <<= 1;
+    }
+    return ret;
+}
+
 //! \param[in] attempt is the name of the syscall to try (for error reporting)
 //! \param[in] return_value is the return value of the syscall
 //! \param[in] errno_mask is any errno value that is acceptable, e.g., `EAGAIN` when reading a non-blocking fd
@@ -51,6 +51,9 @@ std::mt19937 get_random_generator();
 //! Get the time in milliseconds since the program began.
 uint64_t timestamp_ms();
 
+//! The smallest power of two no less than `n` (e.g., the size of a ring buffer that holds `n` bytes)
+size_t next_power_of_two(const size_t n);
+
 //! The internet checksum algorithm
 class InternetChecksum {
   private:
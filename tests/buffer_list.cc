@@ -0,0 +1,200 @@
+#include "buffer.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+using namespace std;
+
+static void check(const bool condition, const string &what) {
+    if (not condition) {
+        throw runtime_error(what);
+    }
+}
+
+static string contents(const BufferViewList &views) {
+    string ret;
+    for (const auto &iov : views.as_iovecs()) {
+        ret.append(static_cast<const char *>(iov.iov_base), iov.iov_len);
+    }
+    return ret;
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        // random appends and removals, checked against a plain string; a few fragments stay inline,
+        // more spill to the heap, and draining and refilling slides or compacts the storage
+        for (unsigned round = 0; round < 200; ++round) {
+            BufferList buffers{};
+            BufferViewList views{};
+            string expected_buffers{}, expected_views{};
+            const string source(4096, 'q');
+
+            for (unsigned step = 0; step < 100; ++step) {
+                if (rd() % 3 != 0) {
+                    string fragment(1 + rd() % 20, 0);
+                    for (auto &c : fragment) {
+                        c = 'a' + rd() % 26;
+                    }
+                    expected_buffers += fragment;
+                    buffers.append(BufferList(string(fragment)));
+
+                    const string_view view = string_view(source).substr(rd() % 100, rd() % 20);
+                    expected_views += view;
+                    views.append(view);
+                } else {
+                    const size_t n = rd() % (expected_buffers.size() + 1);
+                    buffers.remove_prefix(n);
+                    expected_buffers.erase(0, n);
+
+                    const size_t m = rd() % (expected_views.size() + 1);
+                    views.remove_prefix(m);
+                    expected_views.erase(0, m);
+                }
+
+                check(buffers.size() == expected_buffers.size(), "BufferList::size() is wrong");
+                check(buffers.concatenate() == expected_buffers, "BufferList holds the wrong bytes");
+                check(views.size() == expected_views.size(), "BufferViewList::size() is wrong");
+                check(contents(views) == expected_views, "BufferViewList holds the wrong bytes");
+            }
+        }
+
+        // random access and slices of many-fragment lists, checked against a plain string, including
+        // after bytes have been discarded from the front
+        for (unsigned round = 0; round < 100; ++round) {
+            BufferList buffers{};
+            string expected{};
+            for (unsigned i = rd() % 100; i > 0; --i) {
+                string fragment(rd() % 50, 0);
+                for (auto &c : fragment) {
+                    c = 'a' + rd() % 26;
+                }
+                expected += fragment;
+                buffers.append(Buffer(move(fragment)));
+            }
+            const size_t discard = rd() % (expected.size() + 1);
+            buffers.remove_prefix(discard);
+            expected.erase(0, discard);
+
+            for (unsigned i = 0; i < 20 and not expected.empty(); ++i) {
+                const size_t n = rd() % expected.size();
+                check(buffers.at(n) == uint8_t(expected[n]), "BufferList::at() returned the wrong byte");
+            }
+            for (unsigned i = 0; i < 20; ++i) {
+                const size_t offset = rd() % (expected.size() + 1);
+                const size_t len = rd() % (expected.size() - offset + 1);
+                const BufferList slice = buffers.slice(offset, len);
+                check(slice.size() == len, "BufferList::slice() has the wrong size");
+                check(slice.concatenate() == expected.substr(offset, len), "BufferList::slice() has the wrong bytes");
+                if (len > 0) {
+                    check(slice.at(len - 1) == uint8_t(expected[offset + len - 1]), "slice indexed wrongly");
+                }
+            }
+        }
+
+        // a slice shares its storage with the list, and out-of-range access throws
+        {
+            BufferList buffers{string("hello, ")};
+            buffers.append(BufferList(string("wonderful ")));
+            buffers.append(BufferList(string("world")));
+            const BufferList slice = buffers.slice(4, 12);
+            check(slice.concatenate() == "o, wonderful" and slice.buffers().size() == 2, "slice is wrong");
+            check(slice.buffers()[0].str().data() == buffers.buffers()[0].str().data() + 4, "slice copied bytes");
+            check(slice.buffers()[1].str().data() == buffers.buffers()[1].str().data(), "slice copied bytes");
+
+            for (const auto &access : initializer_list<function<void()>>{[&] { buffers.at(buffers.size()); },
+                                                                          [&] { buffers.slice(buffers.size(), 1); },
+                                                                          [&] { buffers.slice(1, buffers.size()); }}) {
+                try {
+                    access();
+                    throw logic_error("out-of-range access did not throw");
+                } catch (const out_of_range &) {
+                }
+            }
+        }
+
+        // a few fragments stay inline; copies are independent, and moved-from lists are empty
+        {
+            BufferList buffers{string("ab")};
+            buffers.append(BufferList(string("cd")));
+            BufferList copy = buffers;
+            copy.remove_prefix(3);
+            check(buffers.concatenate() == "abcd" and copy.concatenate() == "d", "copies are not independent");
+
+            BufferList moved = move(buffers);
+            check(moved.size() == 4 and moved.buffers().size() == 2, "move lost fragments");
+            check(buffers.size() == 0 and buffers.buffers().empty(), "moved-from BufferList is not empty");
+
+            BufferViewList views{moved};
+            BufferViewList moved_views = move(views);
+            check(contents(moved_views) == "abcd", "BufferViewList move lost views");
+            check(views.size() == 0 and views.views().empty(), "moved-from BufferViewList is not empty");
+        }
+
+        // a cursor walks many views through a small iovec array, across random short writes
+        for (unsigned round = 0; round < 100; ++round) {
+            const string source(8192, 'q');
+            BufferViewList views{};
+            string expected{};
+            for (unsigned i = rd() % 200; i > 0; --i) {
+                const string_view view = string_view(source).substr(rd() % 4096, rd() % 30);
+                views.append(view);
+                expected += view;
+            }
+
+            array<iovec, 8> storage;
+            IovecCursor cursor{views, storage.data(), 1 + rd() % storage.size()};
+            string written{};
+            while (not cursor.done()) {
+                check(cursor.count() > 0, "IovecCursor has bytes remaining but no entries");
+                size_t n = rd() % (cursor.remaining() + 1);
+                size_t in_array = 0;
+                for (int i = 0; i < cursor.count(); ++i) {
+                    in_array += cursor.iovecs()[i].iov_len;
+                }
+                n = min(n, in_array);
+                size_t left = n;
+                for (int i = 0; left > 0; ++i) {
+                    const size_t take = min(left, cursor.iovecs()[i].iov_len);
+                    written.append(static_cast<const char *>(cursor.iovecs()[i].iov_base), take);
+                    left -= take;
+                }
+                cursor.advance(n);
+                check(written.size() + cursor.remaining() == expected.size(), "IovecCursor::remaining() is wrong");
+            }
+            check(written == expected, "IovecCursor produced the wrong bytes");
+        }
+
+        // removing more than the list holds throws, and leaves the list alone
+        {
+            BufferList buffers{string("abc")};
+            BufferViewList views{"xyz"};
+            try {
+                buffers.remove_prefix(4);
+                throw logic_error("BufferList::remove_prefix did not throw");
+            } catch (const out_of_range &) {
+            }
+            try {
+                views.remove_prefix(4);
+                throw logic_error("BufferViewList::remove_prefix did not throw");
+            } catch (const out_of_range &) {
+            }
+            check(buffers.concatenate() == "abc" and contents(views) == "xyz", "failed remove_prefix changed the list");
+        }
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,206 @@
+#include "buffer.hh"
+#include "file_descriptor.hh"
+#include "util.hh"
+
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <initializer_list>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+static void check(const bool condition, const string &what) {
+    if (not condition) {
+        throw runtime_error(what);
+    }
+}
+
+//! Run `body` on a new thread (which starts with an empty pool), and rethrow anything it throws
+template <typename T>
+static void on_new_thread(const T &body) {
+    exception_ptr error{};
+    thread worker([&] {
+        try {
+            body();
+        } catch (...) {
+            error = current_exception();
+        }
+    });
+    worker.join();
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+int main() {
+    try {
+        constexpr size_t SMALL = BufferPool::CLASS_SIZES[0], MEDIUM = BufferPool::CLASS_SIZES[1];
+        constexpr size_t LARGE = BufferPool::BLOCK_SIZE;
+
+        // each request is served by the smallest class that fits it; larger ones get a block of their own
+        for (const auto &[size, expected] : initializer_list<pair<size_t, size_t>>{{0, SMALL},
+                                                                                   {1, SMALL},
+                                                                                   {SMALL, SMALL},
+                                                                                   {SMALL + 1, MEDIUM},
+                                                                                   {MEDIUM, MEDIUM},
+                                                                                   {MEDIUM + 1, LARGE},
+                                                                                   {LARGE, LARGE},
+                                                                                   {LARGE + 1, LARGE + 1}}) {
+            const BufferPool::Block block = BufferPool::acquire(size);
+            check(block.capacity() == expected, "block has the wrong capacity for " + to_string(size) + " bytes");
+            check(BufferPool::block_size(size) == expected, "block_size() disagrees with acquire()");
+            memset(block.data(), 'x', block.capacity());
+        }
+
+        // a released block is handed out again, and only once its last copy is gone
+        on_new_thread([&] {
+            BufferPool::Block block = BufferPool::acquire(MEDIUM);
+            const char *const storage = block.data();
+            check(BufferPool::stats(MEDIUM).misses == 1 and BufferPool::stats(MEDIUM).hits == 0, "first acquire hit");
+
+            BufferPool::Block copy = block;
+            block.reset();
+            check(not block and copy.data() == storage, "reset affected the copy");
+            check(BufferPool::stats(MEDIUM).recycled == 0, "block recycled while still referenced");
+
+            copy = BufferPool::Block{};
+            check(BufferPool::stats(MEDIUM).recycled == 1, "block not recycled after its last copy");
+
+            block = BufferPool::acquire(MEDIUM - 1);
+            check(block.data() == storage, "recycled block not reused");
+            check(BufferPool::stats(MEDIUM).hits == 1 and BufferPool::stats(MEDIUM).misses == 1, "wrong counts");
+            check(BufferPool::stats(SMALL).misses == 0 and BufferPool::stats(LARGE).misses == 0, "wrong class counted");
+        });
+
+        // each free list is bounded, and blocks beyond the bound are freed
+        on_new_thread([&] {
+            vector<BufferPool::Block> blocks{};
+            for (size_t i = 0; i < BufferPool::MAX_FREE_BLOCKS + 5; ++i) {
+                blocks.push_back(BufferPool::acquire(SMALL));
+            }
+            blocks.clear();
+            const BufferPool::Stats stats = BufferPool::stats(SMALL);
+            check(stats.recycled == BufferPool::MAX_FREE_BLOCKS and stats.discarded == 5, "free list not bounded");
+        });
+
+#ifndef SPONGE_LOCAL_REFCOUNT
+        // a block goes to the free list of the thread that releases it
+        {
+            const BufferPool::Stats before = BufferPool::stats(LARGE);
+            BufferPool::Block block = BufferPool::acquire(LARGE);
+            on_new_thread([&] {
+                block.reset();
+                check(BufferPool::stats(LARGE).recycled == 1, "block not recycled by the releasing thread");
+            });
+            check(BufferPool::stats(LARGE).recycled == before.recycled, "block recycled by the acquiring thread");
+        }
+#endif
+
+        // a Buffer made from a string keeps the string's bytes, and is not pooled
+        {
+            const BufferPool::Stats before = BufferPool::stats(SMALL);
+            Buffer buffer{string("hello, world")};
+            Buffer copy = buffer;
+            buffer.remove_prefix(7);
+            check(buffer.str() == "world" and copy.str() == "hello, world", "adopted Buffer has the wrong bytes");
+            buffer = Buffer{};
+            copy = Buffer{};
+            check(BufferPool::stats(SMALL).recycled == before.recycled, "adopted string went to the pool");
+        }
+
+        // a short read lands in a small block, so the large one it was read into goes straight back
+        on_new_thread([&] {
+            int pipe_fds[2];
+            SystemCall("pipe", ::pipe(pipe_fds));
+            FileDescriptor read_end{pipe_fds[0]}, write_end{pipe_fds[1]};
+
+            write_end.write("abc");
+            Buffer buffer = read_end.read_buffer();
+            check(buffer.str() == "abc", "read_buffer returned the wrong bytes");
+            check(BufferPool::stats(LARGE).recycled == 1, "large block was not released after a short read");
+            check(BufferPool::stats(SMALL).misses == 1, "short read was not copied into a small block");
+
+            write_end.write(string(3000, 'y'));
+            BufferList buffers{};
+            check(read_end.read(buffers, 3000) == 3000, "read into a BufferList was short");
+            check(BufferPool::stats(MEDIUM).misses == 1 and BufferPool::stats(LARGE).hits == 0,
+                  "limited read did not use the smallest class that fits");
+            check(buffers.concatenate() == string(3000, 'y'), "read into a BufferList returned the wrong bytes");
+        });
+
+        // a read into a string borrows a pooled block no larger than its limit, and gives it back
+        on_new_thread([&] {
+            int pipe_fds[2];
+            SystemCall("pipe", ::pipe(pipe_fds));
+            FileDescriptor read_end{pipe_fds[0]}, write_end{pipe_fds[1]};
+
+            write_end.write("abc");
+            check(read_end.read(100) == "abc", "read into a string returned the wrong bytes");
+            check(BufferPool::stats(SMALL).misses == 1 and BufferPool::stats(SMALL).recycled == 1,
+                  "read into a string did not borrow a small block");
+            check(BufferPool::stats(LARGE).misses == 0, "read into a string used a block larger than its limit");
+
+            // with no limit, it borrows pooled blocks, not a large block of its own
+            write_end.write(string(3000, 'z'));
+            check(read_end.read() == string(3000, 'z'), "unlimited read into a string returned the wrong bytes");
+            const size_t borrowed = BufferPool::stats(LARGE).misses;
+            check(borrowed > 1 and BufferPool::stats(LARGE).recycled == borrowed,
+                  "unlimited read into a string did not borrow pooled blocks");
+            write_end.write("abc");
+            check(read_end.read() == "abc", "second unlimited read into a string returned the wrong bytes");
+            check(BufferPool::stats(LARGE).misses == borrowed and BufferPool::stats(LARGE).hits == borrowed,
+                  "unlimited read into a string did not reuse its pooled blocks");
+        });
+
+        // both reference count policies report the last release, and start over when reset
+        {
+            AtomicRefCount shared{};
+            LocalRefCount local{};
+            shared.increment();
+            local.increment();
+            check(not shared.decrement() and not local.decrement(), "release of a shared count was the last");
+            check(shared.decrement() and local.decrement(), "last release was not reported");
+            shared.reset();
+            local.reset();
+            check(shared.decrement() and local.decrement(), "reset count does not have one reference");
+        }
+
+#ifndef NDEBUG
+        // in debug builds, a LocalRefCount touched by a second thread stops the program
+        {
+            const pid_t child = SystemCall("fork", fork());
+            if (child == 0) {
+                SystemCall("dup2", dup2(SystemCall("open", open("/dev/null", O_WRONLY)), STDERR_FILENO));
+                LocalRefCount count{};
+                thread([&] { count.increment(); }).join();
+                _exit(EXIT_SUCCESS);
+            }
+            int status = 0;
+            SystemCall("waitpid", waitpid(child, &status, 0));
+            check(WIFSIGNALED(status) and WTERMSIG(status) == SIGABRT,
+                  "cross-thread use of LocalRefCount went unnoticed");
+        }
+#endif
+
+        // only pooled sizes have counts
+        try {
+            BufferPool::stats(LARGE + 1);
+            throw logic_error("stats() of an unpooled size did not throw");
+        } catch (const out_of_range &) {
+        }
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+#include "byte_stream.hh"
+#include "byte_stream_test_harness.hh"
+
+#include <exception>
+#include <iostream>
+
+using namespace std;
+
+int main() {
+    try {
+        {
+            ByteStreamTestHarness test{"copy-adopt-copy", 15};
+
+            test.execute(Write{"cat"});
+            test.execute(WriteBuffer{"dog"}.with_bytes_written(3));
+            test.execute(Write{"bat"});
+
+            test.execute(BytesWritten{9});
+            test.execute(RemainingCapacity{6});
+            test.execute(BufferSize{9});
+            test.execute(Peek{"catdogbat"});
+
+            test.execute(Pop{4});
+
+            test.execute(BytesRead{4});
+            test.execute(BufferSize{5});
+            test.execute(Peek{"ogbat"});
+
+            test.execute(Pop{5});
+            test.execute(Write{"emu"});
+
+            test.execute(BufferEmpty{false});
+            test.execute(BytesWritten{12});
+            test.execute(BytesRead{9});
+            test.execute(RemainingCapacity{12});
+            test.execute(Peek{"emu"});
+        }
+
+        {
+            ByteStreamTestHarness test{"adopt-partial", 5};
+
+            test.execute(Write{"ab"});
+            test.execute(WriteBuffer{"cdefg"}.with_bytes_written(3));
+
+            test.execute(RemainingCapacity{0});
+            test.execute(BufferSize{5});
+            test.execute(Peek{"abcde"});
+
+            test.execute(WriteBuffer{"h"}.with_bytes_written(0));
+            test.execute(Pop{3});
+            test.execute(Peek{"de"});
+            test.execute(Write{"xyz"}.with_bytes_written(3));
+            test.execute(EndInput{});
+
+            test.execute(Peek{"dexyz"});
+            test.execute(Pop{5});
+
+            test.execute(Eof{true});
+            test.execute(BytesRead{8});
+            test.execute(BytesWritten{8});
+        }
+
+        {
+            ByteStreamTestHarness test{"interleaved", 8};
+
+            test.execute(Write{"ab"});
+            test.execute(WriteBuffer{"CD"}.with_bytes_written(2));
+            test.execute(WriteViews{{"e", "f"}}.with_bytes_written(2));
+            test.execute(WriteBuffer{"GH"}.with_bytes_written(2));
+
+            test.execute(RemainingCapacity{0});
+            test.execute(Peek{"abCDefGH"});
+
+            test.execute(Pop{3});
+            test.execute(Peek{"DefGH"});
+            test.execute(Write{"ijk"}.with_bytes_written(3));
+            test.execute(Peek{"DefGHijk"});
+
+            test.execute(Pop{5});
+            test.execute(Write{"lmnop"}.with_bytes_written(5));
+            test.execute(WriteBuffer{"Q"}.with_bytes_written(0));
+            test.execute(Peek{"ijklmnop"});
+
+            test.execute(Pop{6});
+            test.execute(WriteBuffer{"QR"}.with_bytes_written(2));
+            test.execute(Write{"st"}.with_bytes_written(2));
+            test.execute(Write{"uvw"}.with_bytes_written(2));
+            test.execute(Peek{"opQRstuv"});
+
+            test.execute(Pop{8});
+            test.execute(BufferEmpty{true});
+            test.execute(BytesRead{22});
+            test.execute(BytesWritten{22});
+        }
+
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+#include "concurrent_byte_stream.hh"
+#include "eventloop.hh"
+#include "util.hh"
+
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+static constexpr size_t CAPACITY = 4093;
+static constexpr size_t TOTAL = 4 * 1024 * 1024;
+static constexpr size_t MAX_WRITE = 3000;
+
+// the byte at stream index `i`
+static char expected_byte(const size_t i) { return static_cast<char>('a' + (i * 7 + i / 251) % 26); }
+
+// stream TOTAL bytes from a writer thread to this one, either spinning or parking on the stream's events
+static void stress(const bool blocking) {
+    ConcurrentByteStream stream{CAPACITY};
+
+    thread writer([&] {
+        auto rd = get_random_generator();
+        string chunk;
+        size_t written = 0;
+        while (written < TOTAL) {
+            chunk.resize(1 + rd() % min(MAX_WRITE, TOTAL - written));
+            for (size_t i = 0; i < chunk.size(); ++i) {
+                chunk[i] = expected_byte(written + i);
+            }
+            const size_t accepted = blocking ? stream.write_wait(chunk) : stream.write(chunk);
+            if (accepted == 0) {
+                this_thread::yield();
+            }
+            written += accepted;
+        }
+        stream.end_input();
+    });
+
+    auto rd = get_random_generator();
+    size_t read = 0;
+    bool peek_next = false;
+    while (not stream.eof()) {
+        const size_t len = 1 + rd() % MAX_WRITE;
+        string data;
+        if (blocking) {
+            data = stream.read_wait(len);
+        } else if (peek_next) {
+            for (const auto &iov : stream.peek_views(len).as_iovecs()) {
+                data.append(static_cast<const char *>(iov.iov_base), iov.iov_len);
+            }
+            stream.pop_output(data.size());
+        } else {
+            data = stream.read(len);
+        }
+        peek_next = not peek_next;
+        if (data.empty() and not blocking) {
+            this_thread::yield();
+        }
+
+        for (size_t i = 0; i < data.size(); ++i) {
+            if (data[i] != expected_byte(read + i)) {
+                throw runtime_error("corrupt byte at stream index " + to_string(read + i));
+            }
+        }
+        read += data.size();
+        if (stream.buffer_size() > CAPACITY) {
+            throw runtime_error("buffer_size exceeds capacity");
+        }
+    }
+    writer.join();
+
+    if (read != TOTAL or stream.bytes_read() != TOTAL or stream.bytes_written() != TOTAL) {
+        throw runtime_error("expected " + to_string(TOTAL) + " bytes, but read " + to_string(read));
+    }
+}
+
+// stream TOTAL bytes between two threads that each run an EventLoop, woken by the stream's events
+static void event_loops(const EventLoop::Backend backend) {
+    ConcurrentByteStream stream{CAPACITY};
+
+    thread writer([&] {
+        EventLoop loop{backend};
+        auto rd = get_random_generator();
+        string chunk;
+        size_t written = 0;
+        stream.arm_write_event();
+        loop.add_rule(
+            stream.write_event(),
+            Direction::In,  // the eventfd becomes readable once there is room
+            [&] {
+                stream.clear_write_event();
+                size_t accepted = 0;
+                do {
+                    chunk.resize(1 + rd() % min(MAX_WRITE, TOTAL - written));
+                    for (size_t i = 0; i < chunk.size(); ++i) {
+                        chunk[i] = expected_byte(written + i);
+                    }
+                    accepted = stream.write(chunk);
+                    written += accepted;
+                } while (accepted > 0 and written < TOTAL);
+                if (written == TOTAL) {
+                    stream.end_input();
+                } else {
+                    stream.arm_write_event();
+                }
+            },
+            [&] { return written < TOTAL; });
+        while (loop.wait_next_event(-1) != EventLoop::Result::Exit) {
+        }
+    });
+
+    EventLoop loop{backend};
+    size_t read = 0;
+    stream.arm_read_event();
+    loop.add_rule(
+        stream.read_event(),
+        Direction::In,
+        [&] {
+            stream.clear_read_event();
+            const string data = stream.read(stream.buffer_size());
+            for (size_t i = 0; i < data.size(); ++i) {
+                if (data[i] != expected_byte(read + i)) {
+                    throw runtime_error("corrupt byte at stream index " + to_string(read + i));
+                }
+            }
+            read += data.size();
+            if (not stream.eof()) {
+                stream.arm_read_event();
+            }
+        },
+        [&] { return not stream.eof(); });
+    while (loop.wait_next_event(-1) != EventLoop::Result::Exit) {
+    }
+    writer.join();
+
+    if (read != TOTAL or not stream.eof()) {
+        throw runtime_error("event loop expected " + to_string(TOTAL) + " bytes, but read " + to_string(read));
+    }
+}
+
+int main() {
+    try {
+        stress(false);
+        stress(true);
+        for (const auto backend : {EventLoop::Backend::Poll,
+                                   EventLoop::Backend::EpollLevel,
+                                   EventLoop::Backend::EpollEdge,
+                                   EventLoop::Backend::IoUring}) {
+            event_loops(backend);
+        }
+
+        {
+            ConcurrentByteStream stream{4};
+
+            if (not stream.read_wait(1, 10).empty()) {
+                throw runtime_error("read_wait on an empty stream should time out");
+            }
+            if (stream.write_wait("abcdef", 10) != 4) {
+                throw runtime_error("write_wait on a full stream should time out");
+            }
+            if (stream.read_wait(2, 10) != "ab") {
+                throw runtime_error("read_wait should return buffered data without waiting");
+            }
+        }
+
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+#include "byte_stream.hh"
+#include "file_descriptor.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <utility>
+
+using namespace std;
+
+// a pipe as a (read end, write end) pair of FileDescriptors
+static pair<FileDescriptor, FileDescriptor> make_pipe() {
+    int fds[2];
+    SystemCall("pipe", ::pipe(fds));
+    return {FileDescriptor(fds[0]), FileDescriptor(fds[1])};
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+        const size_t CAPACITY = 1000;
+
+        {
+            auto [in_read, in_write] = make_pipe();
+            auto [out_read, out_write] = make_pipe();
+            ByteStream stream{CAPACITY};
+
+            string expected, actual;
+            for (size_t round = 0; round < 200; ++round) {
+                string data(1 + rd() % 700, 0);
+                generate(data.begin(), data.end(), [&] { return 'a' + (rd() % 26); });
+                in_write.write(data);
+                expected += data;
+
+                // drain the input pipe through the stream, a limited number of bytes at a time
+                for (size_t pending = data.size(); pending > 0;) {
+                    const size_t accepted = stream.read_from(in_read, 1 + rd() % 500);
+                    pending -= accepted;
+                    if (stream.buffer_size() > CAPACITY) {
+                        throw runtime_error("buffer_size exceeds capacity");
+                    }
+                    stream.write_to(out_write, 1 + rd() % 500);
+                }
+                while (not stream.buffer_empty()) {
+                    stream.write_to(out_write);
+                }
+                actual += out_read.read(data.size());
+            }
+
+            if (actual != expected) {
+                throw runtime_error("bytes did not survive the trip through the stream");
+            }
+            if (stream.bytes_written() != expected.size() or stream.bytes_read() != expected.size()) {
+                throw runtime_error("stream accounting is wrong");
+            }
+
+            in_write.close();
+            if (stream.read_from(in_read) != 0 or not in_read.eof()) {
+                throw runtime_error("read_from should report EOF on a closed pipe");
+            }
+        }
+
+        {
+            auto [in_read, in_write] = make_pipe();
+            ByteStream stream{8};
+            stream.write(Buffer(string("abc")));
+            in_write.write("defghijk");
+
+            if (stream.read_from(in_read) != 5 or stream.peek_output(8) != "abcdefgh") {
+                throw runtime_error("read_from should append after adopted chunks");
+            }
+        }
+
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,57 @@
+#include "byte_stream.hh"
+#include "byte_stream_test_harness.hh"
+
+#include <exception>
+#include <iostream>
+
+using namespace std;
+
+int main() {
+    try {
+        {
+            ByteStreamTestHarness test{"header-payload", 15};
+
+            test.execute(WriteViews{{"hdr:", "payload"}}.with_bytes_written(11));
+
+            test.execute(BytesWritten{11});
+            test.execute(RemainingCapacity{4});
+            test.execute(BufferSize{11});
+            test.execute(Peek{"hdr:payload"});
+
+            test.execute(WriteViews{{"ab", "", "cd", "ef"}}.with_bytes_written(4));
+
+            test.execute(RemainingCapacity{0});
+            test.execute(Peek{"hdr:payloadabcd"});
+
+            test.execute(WriteViews{{"x"}}.with_bytes_written(0));
+            test.execute(Pop{13});
+            test.execute(WriteViews{{"123", "45678"}}.with_bytes_written(8));
+
+            test.execute(BytesWritten{23});
+            test.execute(BytesRead{13});
+            test.execute(Peek{"cd12345678"});
+        }
+
+        {
+            ByteStreamTestHarness test{"fragments-after-adopted", 8};
+
+            test.execute(WriteBuffer{"abc"});
+            test.execute(WriteViews{{"de", "fgh", "ijk"}}.with_bytes_written(5));
+
+            test.execute(RemainingCapacity{0});
+            test.execute(Peek{"abcdefgh"});
+
+            test.execute(Pop{8});
+            test.execute(EndInput{});
+
+            test.execute(Eof{true});
+            test.execute(BytesWritten{8});
+        }
+
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
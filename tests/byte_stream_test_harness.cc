@@ -97,6 +97,44 @@ void Write::execute(ByteStream &bs) const {
     }
 }
 
+// WriteBuffer
+WriteBuffer::WriteBuffer(const std::string &data) : _data(data) {}
+WriteBuffer &WriteBuffer::with_bytes_written(const size_t bytes_written) {
+    _bytes_written = bytes_written;
+    return *this;
+}
+std::string WriteBuffer::description() const { return "write Buffer \"" + _data + "\" to the stream"; }
+void WriteBuffer::execute(ByteStream &bs) const {
+    auto bytes_written = bs.write(Buffer(std::string(_data)));
+    if (_bytes_written and bytes_written != _bytes_written.value()) {
+        throw ByteStreamExpectationViolation::property("bytes_written", _bytes_written.value(), bytes_written);
+    }
+}
+
+// WriteViews
+WriteViews::WriteViews(const std::vector<std::string> &fragments) : _fragments(fragments) {}
+WriteViews &WriteViews::with_bytes_written(const size_t bytes_written) {
+    _bytes_written = bytes_written;
+    return *this;
+}
+std::string WriteViews::description() const {
+    std::string ret = "write fragments";
+    for (const auto &fragment : _fragments) {
+        ret += " \"" + fragment + "\"";
+    }
+    return ret + " to the stream";
+}
+void WriteViews::execute(ByteStream &bs) const {
+    BufferViewList views;
+    for (const auto &fragment : _fragments) {
+        views.append(fragment);
+    }
+    auto bytes_written = bs.write(views);
+    if (_bytes_written and bytes_written != _bytes_written.value()) {
+        throw ByteStreamExpectationViolation::property("bytes_written", _bytes_written.value(), bytes_written);
+    }
+}
+
 // Pop
 Pop::Pop(const size_t len) : _len(len) {}
 std::string Pop::description() const { return "pop " + to_string(_len); }
@@ -181,4 +219,13 @@ void Peek::execute(ByteStream &bs) const {
         throw ByteStreamExpectationViolation("Expected \"" + _output + "\" at the front of the stream, but found \"" +
                                              output + "\"");
     }
+
+    std::string views_output;
+    for (const auto &iov : bs.peek_views(_output.size()).as_iovecs()) {
+        views_output.append(static_cast<const char *>(iov.iov_base), iov.iov_len);
+    }
+    if (views_output != _output) {
+        throw ByteStreamExpectationViolation("Expected \"" + _output + "\" from peek_views(), but found \"" +
+                                             views_output + "\"");
+    }
 }
@@ -10,6 +10,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
 struct ByteStreamTestStep {
     virtual operator std::string() const;
@@ -56,6 +57,26 @@ struct Write : public ByteStreamAction {
     void execute(ByteStream &) const override;
 };
 
+struct WriteBuffer : public ByteStreamAction {
+    std::string _data;
+    std::optional<size_t> _bytes_written{};
+
+    WriteBuffer(const std::string &data);
+    WriteBuffer &with_bytes_written(const size_t bytes_written);
+    std::string description() const override;
+    void execute(ByteStream &) const override;
+};
+
+struct WriteViews : public ByteStreamAction {
+    std::vector<std::string> _fragments;
+    std::optional<size_t> _bytes_written{};
+
+    WriteViews(const std::vector<std::string> &fragments);
+    WriteViews &with_bytes_written(const size_t bytes_written);
+    std::string description() const override;
+    void execute(ByteStream &) const override;
+};
+
 struct Pop : public ByteStreamAction {
     size_t _len;
 
@@ -0,0 +1,400 @@
+#include "address.hh"
+#include "buffer.hh"
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "socket.hh"
+#include "util.hh"
+
+#include <cerrno>
+#include <chrono>
+#include <exception>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// a pipe as a (read end, write end) pair of FileDescriptors
+static pair<FileDescriptor, FileDescriptor> make_pipe() {
+    int fds[2];
+    SystemCall("pipe", ::pipe(fds));
+    return {FileDescriptor(fds[0]), FileDescriptor(fds[1])};
+}
+
+static void check(const bool condition, const string &backend, const string &what) {
+    if (not condition) {
+        throw runtime_error(backend + ": " + what);
+    }
+}
+
+static void test_backend(const EventLoop::Backend backend, const string &name) {
+    // transfer data through a pipe; both rules are canceled (on EOF and on close) and the loop exits
+    {
+        EventLoop loop{backend};
+        auto [read_end, write_end] = make_pipe();
+        const string sent(20000, 'x');
+        string received;
+        bool reader_canceled = false, writer_canceled = false;
+
+        // the writer finishes before the pipe first becomes readable, so the reader can drain it to EOF
+        // (as an edge-triggered callback must)
+        loop.add_rule(
+            read_end,
+            Direction::In,
+            [&] {
+                while (not read_end.eof()) {
+                    received += read_end.read();
+                }
+            },
+            [] { return true; },
+            [&] { reader_canceled = true; });
+        loop.add_rule(
+            write_end,
+            Direction::Out,
+            [&] {
+                write_end.write(sent);
+                write_end.close();
+            },
+            [] { return true; },
+            [&] { writer_canceled = true; });
+
+        unsigned iterations = 0;
+        while (loop.wait_next_event(1000) != EventLoop::Result::Exit) {
+            check(++iterations < 100, name, "loop did not exit");
+        }
+        check(received == sent, name, "data did not arrive intact");
+        check(reader_canceled and writer_canceled, name, "rules were not canceled");
+    }
+
+    // an uninterested rule is not called back, and is called once it becomes interested again
+    {
+        EventLoop loop{backend};
+        auto [read_end, write_end] = make_pipe();
+        write_end.write("hello");
+        bool interested = false;
+        unsigned callbacks = 0;
+
+        loop.add_rule(read_end, Direction::In, [&] {
+            read_end.read();
+            ++callbacks;
+        }, [&] { return interested; });
+
+        unsigned iterations = 0;
+        while (loop.wait_next_event(0) != EventLoop::Result::Exit) {
+            check(++iterations < 10, name, "loop with only uninterested rules did not exit");
+        }
+        check(callbacks == 0, name, "uninterested rule was called back");
+
+        interested = true;
+        check(loop.wait_next_event(1000) == EventLoop::Result::Success, name, "interested rule was not polled");
+        check(callbacks == 1, name, "interested rule was not called back");
+        check(loop.wait_next_event(0) == EventLoop::Result::Timeout, name, "expected a timeout with nothing to read");
+    }
+
+    // once every rule has lost interest while its fd is idle, the loop exits (with poll, at once; with
+    // epoll, which does not ask the watched rules again until their fds are ready, after a timeout)
+    {
+        EventLoop loop{backend};
+        auto [read_end, write_end] = make_pipe();
+        bool interested = true;
+        loop.add_rule(read_end, Direction::In, [&] { read_end.read(); }, [&] { return interested; });
+        loop.add_rule(write_end, Direction::Out, [&] { write_end.write("x"); }, [] { return false; });
+
+        check(loop.wait_next_event(0) == EventLoop::Result::Timeout, name, "expected a timeout with nothing to read");
+        interested = false;
+        const EventLoop::Result first = loop.wait_next_event(10);
+        const bool uses_epoll = backend == EventLoop::Backend::EpollLevel or backend == EventLoop::Backend::EpollEdge;
+        check(first == (uses_epoll ? EventLoop::Result::Timeout : EventLoop::Result::Exit),
+              name,
+              "loop of uninterested rules did not exit");
+        check(loop.wait_next_event(-1) == EventLoop::Result::Exit, name, "loop of uninterested rules did not exit");
+    }
+
+    // with many idle rules, a wakeup asks only the ready fd's rule whether it is interested
+    {
+        EventLoop loop{backend};
+        vector<pair<FileDescriptor, FileDescriptor>> idle{};
+        unsigned questions = 0;
+        for (unsigned i = 0; i < 100; ++i) {
+            idle.push_back(make_pipe());
+            loop.add_rule(idle.back().first, Direction::In, [] {}, [&] { return ++questions > 0; });
+        }
+        auto [read_end, write_end] = make_pipe();
+        loop.add_rule(read_end, Direction::In, [&] { read_end.read(); });
+
+        write_end.write("x");
+        check(loop.wait_next_event(1000) == EventLoop::Result::Success, name, "ready rule was not called back");
+        questions = 0;
+        write_end.write("x");
+        check(loop.wait_next_event(1000) == EventLoop::Result::Success, name, "ready rule was not called back");
+        const bool uses_epoll = backend == EventLoop::Backend::EpollLevel or backend == EventLoop::Backend::EpollEdge;
+        check(not uses_epoll or questions == 0, name, "epoll asked idle rules whether they were interested");
+    }
+
+    // canceling a rule (here, on hangup) releases its references to the fd at once
+    {
+        EventLoop loop{backend};
+        int fd = -1;
+        {
+            auto [read_end, write_end] = make_pipe();
+            fd = read_end.fd_num();
+            const auto reader = make_shared<FileDescriptor>(read_end.duplicate());
+            loop.add_rule(read_end, Direction::In, [reader] { reader->read(); });
+        }
+        check(loop.wait_next_event(1000) == EventLoop::Result::Success, name, "hangup was not noticed");
+        check(::fcntl(fd, F_GETFD) < 0 and errno == EBADF, name, "canceled rule kept its fd open");
+    }
+
+    // async operations: a writev and a read through a pipe, then a read at EOF
+    {
+        EventLoop loop{backend};
+        auto [read_end, write_end] = make_pipe();
+        const string first = "hello, ", second = "world";
+        BufferViewList views{first};
+        views.append(second);
+        size_t bytes_written = 0;
+        string received;
+        unsigned completions = 0;
+
+        loop.writev_async(write_end, views, [&](const size_t count) {
+            bytes_written = count;
+            ++completions;
+        });
+        const uint64_t large_recycled = BufferPool::stats().recycled;
+        bool fitted = false;
+        loop.read_async(read_end, [&](const Buffer data) {
+            received = data;
+            fitted = BufferPool::stats().recycled == large_recycled + 1;  // a short read gives its block back
+            ++completions;
+        });
+
+        unsigned iterations = 0;
+        while (completions < 2) {
+            check(loop.wait_next_event(1000) != EventLoop::Result::Exit, name, "loop exited with operations pending");
+            check(++iterations < 10, name, "async operations did not complete");
+        }
+        check(bytes_written == first.size() + second.size(), name, "writev_async wrote the wrong number of bytes");
+        check(received == first + second, name, "read_async read the wrong bytes");
+        check(fitted, name, "short read_async pinned a large block");
+        check(read_end.read_count() == 1 and write_end.write_count() == 1, name, "async operations were not counted");
+
+        write_end.close();
+        bool at_eof = false;
+        loop.read_async(read_end, [&](const Buffer data) { at_eof = data.size() == 0; });
+        while (not at_eof) {
+            check(loop.wait_next_event(1000) != EventLoop::Result::Exit, name, "loop exited with a read pending");
+            check(++iterations < 20, name, "read at EOF did not complete");
+        }
+        // io_uring reads at EOF, which sets the flag (the other backends see the hangup, and don't read)
+        check(loop.backend() != EventLoop::Backend::IoUring or read_end.eof(),
+              name,
+              "read_async at EOF did not set the EOF flag");
+        check(loop.wait_next_event(0) == EventLoop::Result::Exit, name, "finished operations were not dropped");
+    }
+
+    // timers fire in order, no sooner than their delay, and keep the loop alive without any rules
+    {
+        EventLoop loop{backend};
+        const uint64_t start = timestamp_ms();
+        vector<unsigned> fired{};
+        loop.add_timer(30, [&] { fired.push_back(2); });
+        loop.add_timer(10, [&] { fired.push_back(1); });
+        const auto canceled = loop.add_timer(20, [&] { fired.push_back(0); });
+        check(loop.cancel_timer(canceled) and not loop.cancel_timer(canceled), name, "timer cancellation failed");
+
+        unsigned iterations = 0;
+        while (loop.wait_next_event(-1) != EventLoop::Result::Exit) {
+            check(++iterations < 10, name, "loop with only timers did not exit");
+        }
+        check(fired == vector<unsigned>{1, 2}, name, "timers fired in the wrong order, or a canceled timer fired");
+        check(timestamp_ms() - start >= 30, name, "timer fired early");
+    }
+
+    // a timer armed after the loop has been idle for a while is measured from when it was armed
+    {
+        EventLoop loop{backend};
+        check(loop.wait_next_event(0) == EventLoop::Result::Exit, name, "empty loop did not exit");
+        this_thread::sleep_for(chrono::milliseconds(100));
+        const uint64_t armed = timestamp_ms();
+        bool fired = false;
+        loop.add_timer(50, [&] { fired = true; });
+        while (loop.wait_next_event(-1) != EventLoop::Result::Exit) {
+        }
+        check(fired and timestamp_ms() - armed >= 50, name, "timer armed after an idle spell fired early");
+    }
+
+    // a burst of connections is accepted in one wakeup, as non-blocking sockets
+    {
+        EventLoop loop{backend};
+        TCPSocket listener;
+        listener.set_reuseaddr();
+        listener.bind(Address("127.0.0.1", 0));
+        listener.listen(16);
+        listener.set_blocking(false);
+
+        vector<TCPSocket> clients(10);
+        for (auto &client : clients) {
+            client.connect(listener.local_address());
+        }
+
+        vector<TCPSocket> accepted{};
+        unsigned wakeups = 0;
+        loop.add_rule(listener, Direction::In, [&] {
+            ++wakeups;
+            for (auto &socket : listener.accept_batch()) {
+                accepted.push_back(move(socket));
+            }
+        });
+        check(loop.wait_next_event(1000) == EventLoop::Result::Success, name, "listener was not readable");
+        check(wakeups == 1 and accepted.size() == clients.size(), name, "burst of connections was not accepted");
+        check(listener.accept_batch().empty(), name, "accept_batch() found a connection that was not made");
+
+        const int fd = accepted.front().fd_num();
+        check((SystemCall("fcntl", ::fcntl(fd, F_GETFL)) & O_NONBLOCK) != 0, name, "accepted socket is blocking");
+        check((SystemCall("fcntl", ::fcntl(fd, F_GETFD)) & FD_CLOEXEC) != 0,
+              name,
+              "accepted socket is not close-on-exec");
+        clients.front().write("x");
+        check(accepted.front().read() == "x", name, "accepted socket is not connected");
+
+        // running out of file descriptors ends a batch early, keeping what it accepted
+        vector<TCPSocket> waiting(3);
+        for (auto &client : waiting) {
+            client.connect(listener.local_address());
+        }
+        rlimit limit{};
+        SystemCall("getrlimit", ::getrlimit(RLIMIT_NOFILE, &limit));
+        const rlimit original = limit;
+        const int next_fd = SystemCall("dup", ::dup(listener.fd_num()));  // the lowest free descriptor
+        SystemCall("close", ::close(next_fd));
+        limit.rlim_cur = next_fd + 1;  // room for one more
+        SystemCall("setrlimit", ::setrlimit(RLIMIT_NOFILE, &limit));
+        const size_t before_limit = listener.accept_batch().size();
+        SystemCall("setrlimit", ::setrlimit(RLIMIT_NOFILE, &original));
+        check(before_limit == 1, name, "accept_batch() did not stop at the descriptor limit");
+        check(listener.accept_batch().size() == waiting.size() - 1, name, "connections were lost at the limit");
+    }
+
+    // a zerocopy send's buffers are released by a Direction::Error rule once the kernel is done with them
+    // (edge-triggered rules would have to drain the sockets, which the blocking receiver cannot do)
+    if (backend != EventLoop::Backend::EpollEdge) {
+        EventLoop loop{backend};
+        TCPSocket listener;
+        listener.set_reuseaddr();
+        listener.bind(Address("127.0.0.1", 0));
+        listener.listen(1);
+        TCPSocket sender;
+        sender.connect(listener.local_address());
+        TCPSocket receiver = listener.accept();
+        sender.set_blocking(false);
+
+        string payload(4 << 20, 0);
+        for (size_t i = 0; i < payload.size(); ++i) {
+            payload[i] = 'a' + i % 23;
+        }
+        BufferList unsent{string(payload)};
+        string received{};
+
+        loop.add_rule(sender, Direction::Error, [&] { sender.reap_zerocopy(); });
+        loop.add_rule(
+            sender,
+            Direction::Out,
+            [&] { unsent.remove_prefix(sender.send_zerocopy(unsent, false)); },
+            [&] { return unsent.size() > 0; });
+        loop.add_rule(receiver, Direction::In, [&] { received += receiver.read(); });
+
+        unsigned iterations = 0;
+        while (received.size() < payload.size() or sender.zerocopy_pending() > 0) {
+            check(loop.wait_next_event(1000) == EventLoop::Result::Success, name, "zerocopy transfer stalled");
+            check(++iterations < 100000, name, "zerocopy transfer did not finish");
+        }
+        check(received == payload, name, "zerocopy transfer corrupted the data");
+    }
+
+    // a socket error (here, a reset by the peer) is thrown by reap_zerocopy, rather than spinning the loop
+    {
+        EventLoop loop{backend};
+        TCPSocket listener;
+        listener.set_reuseaddr();
+        listener.bind(Address("127.0.0.1", 0));
+        listener.listen(1);
+        TCPSocket sender;
+        sender.connect(listener.local_address());
+        TCPSocket receiver = listener.accept();
+        sender.send_zerocopy(BufferList(string(1000, 'z')));
+
+        const linger reset{1, 0};
+        SystemCall("setsockopt", ::setsockopt(receiver.fd_num(), SOL_SOCKET, SO_LINGER, &reset, sizeof(reset)));
+        receiver.close();
+
+        loop.add_rule(sender, Direction::Error, [&] { sender.reap_zerocopy(); });
+        int error = 0;
+        try {
+            for (unsigned iterations = 0; iterations < 100; ++iterations) {
+                loop.wait_next_event(1000);
+            }
+        } catch (const unix_error &e) {
+            error = e.code().value();
+        }
+        check(error == ECONNRESET, name, "socket error was not reported by reap_zerocopy");
+    }
+}
+
+// a socket destroyed with zerocopy sends in flight waits for them, so their buffers are not reused too soon
+static void test_zerocopy_outlives_socket() {
+    TCPSocket listener;
+    listener.set_reuseaddr();
+    listener.bind(Address("127.0.0.1", 0));
+    const int receive_buffer = 4096;  // so that most of the data waits in the sender's queue
+    SystemCall("setsockopt",
+               ::setsockopt(listener.fd_num(), SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer)));
+    listener.listen(1);
+    auto sender = make_unique<TCPSocket>();
+    sender->connect(listener.local_address());
+    TCPSocket receiver = listener.accept();
+    sender->set_blocking(false);
+
+    const string payload(1 << 20, 'q');
+    const size_t sent = sender->send_zerocopy(BufferList(string(payload)), false);
+    check(sent > 0 and sender->zerocopy_pending() > 0, "zerocopy", "expected zerocopy sends in flight");
+
+    string received{};
+    thread reader([&] {
+        this_thread::sleep_for(chrono::milliseconds(200));
+        while (received.size() < sent) {
+            received += receiver.read();
+        }
+    });
+    const auto start = chrono::steady_clock::now();
+    sender.reset();
+    const auto elapsed = chrono::steady_clock::now() - start;
+    reader.join();
+    check(elapsed >= chrono::milliseconds(150), "zerocopy", "socket was destroyed before its sends completed");
+    check(received == payload.substr(0, sent), "zerocopy", "data sent by a destroyed socket was corrupted");
+}
+
+int main() {
+    try {
+        test_zerocopy_outlives_socket();
+        test_backend(EventLoop::Backend::Poll, "poll");
+        test_backend(EventLoop::Backend::EpollLevel, "epoll (level-triggered)");
+        test_backend(EventLoop::Backend::EpollEdge, "epoll (edge-triggered)");
+
+        EventLoop uring{EventLoop::Backend::IoUring};
+        test_backend(EventLoop::Backend::IoUring,
+                     uring.backend() == EventLoop::Backend::IoUring ? "io_uring" : "io_uring (poll fallback)");
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
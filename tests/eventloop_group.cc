@@ -0,0 +1,228 @@
+#include "address.hh"
+#include "eventloop_group.hh"
+#include "socket.hh"
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static void check(const bool condition, const string &what) {
+    if (not condition) {
+        throw runtime_error(what);
+    }
+}
+
+template <typename T>
+static T wait_for(future<T> &result, const string &what) {
+    check(result.wait_for(chrono::seconds(10)) == future_status::ready, what + " timed out");
+    return result.get();
+}
+
+// tasks run on their loop's thread, each loop on its own thread, in the order they were posted
+static void test_post() {
+    EventLoopGroup group{4};
+    check(group.size() == 4, "wrong number of loops");
+
+    vector<vector<unsigned>> order(group.size());
+    vector<thread::id> ids(group.size());
+    promise<void> done;
+    atomic<size_t> remaining{group.size()};
+
+    for (size_t index = 0; index < group.size(); ++index) {
+        for (unsigned i = 0; i < 100; ++i) {
+            group.post(index, [&, index, i](EventLoop &) {
+                order[index].push_back(i);
+                ids[index] = this_thread::get_id();
+                if (i == 99 and --remaining == 0) {
+                    done.set_value();
+                }
+            });
+        }
+    }
+
+    auto finished = done.get_future();
+    wait_for(finished, "posted tasks");
+    check(set<thread::id>(ids.begin(), ids.end()).size() == group.size(), "loops do not have their own threads");
+    for (const auto &tasks : order) {
+        for (unsigned i = 0; i < tasks.size(); ++i) {
+            check(tasks[i] == i, "tasks ran out of order");
+        }
+    }
+}
+
+// many threads post onto one loop at once, and loops post onto each other
+static void test_producers() {
+    EventLoopGroup group{2};
+    constexpr unsigned PRODUCERS = 4, TASKS = 20000;
+
+    vector<unsigned> next(PRODUCERS, 0);
+    bool in_order = true;
+    promise<void> done;
+    unsigned ran = 0;
+
+    vector<thread> producers{};
+    for (unsigned producer = 0; producer < PRODUCERS; ++producer) {
+        producers.emplace_back([&, producer] {
+            for (unsigned i = 0; i < TASKS; ++i) {
+                group.post(0, [&, producer, i](EventLoop &) {
+                    in_order &= next[producer]++ == i;
+                    if (++ran == PRODUCERS * TASKS) {
+                        done.set_value();
+                    }
+                });
+            }
+        });
+    }
+    for (auto &producer : producers) {
+        producer.join();
+    }
+    auto finished = done.get_future();
+    wait_for(finished, "tasks from many producers");
+    check(in_order, "tasks from one producer ran out of order");
+
+    // ping-pong between the two loops
+    promise<unsigned> rallies;
+    function<void(unsigned)> volley = [&](const unsigned count) {
+        group.post(count % 2, [&, count](EventLoop &) {
+            if (count == 1000) {
+                rallies.set_value(count);
+            } else {
+                volley(count + 1);
+            }
+        });
+    };
+    volley(0);
+    auto rallied = rallies.get_future();
+    check(wait_for(rallied, "ping-pong") == 1000, "ping-pong ended early");
+}
+
+// accepted connections are spread over the loops, and handled there
+static void test_dispatch(const EventLoopGroup::Distribution distribution) {
+    EventLoopGroup group{3, distribution};
+
+    TCPSocket listener;
+    listener.set_reuseaddr();
+    listener.bind(Address("127.0.0.1", 0));
+    listener.listen();
+
+    constexpr unsigned CONNECTIONS = 9;
+    vector<TCPSocket> clients(CONNECTIONS);
+    vector<size_t> chosen{};
+    mutex handled_mutex;
+    vector<string> received{};
+    promise<void> done;
+
+    for (auto &client : clients) {
+        client.connect(listener.local_address());
+        chosen.push_back(group.dispatch(listener.accept(), [&](EventLoop &loop, TCPSocket &&socket) {
+            // read one message from the connection on this loop, then let the connection go
+            auto connection = make_shared<TCPSocket>(move(socket));
+            loop.add_rule(*connection, Direction::In, [&, connection] {
+                const string message = connection->read();
+                connection->close();
+                const lock_guard<mutex> lock(handled_mutex);
+                received.push_back(message);
+                if (received.size() == CONNECTIONS) {
+                    done.set_value();
+                }
+            });
+        }));
+    }
+    for (auto &client : clients) {
+        client.write("hello");
+    }
+
+    auto finished = done.get_future();
+    wait_for(finished, "dispatched connections");
+    check(received == vector<string>(CONNECTIONS, "hello"), "dispatched connections were not handled");
+    for (size_t i = 0; i < CONNECTIONS; ++i) {
+        if (distribution == EventLoopGroup::Distribution::RoundRobin) {
+            check(chosen[i] == i % group.size(), "connections were not dispatched round-robin");
+        } else {
+            check(chosen[i] == chosen[0], "connections from one host went to different loops");
+        }
+    }
+}
+
+// every loop accepts connections on its own listening socket
+static void test_listen() {
+    EventLoopGroup group{3};
+
+    constexpr unsigned CONNECTIONS = 30;
+    mutex handled_mutex;
+    vector<string> received{};
+    set<thread::id> threads{};
+    promise<void> done;
+
+    const Address address = group.listen(Address("127.0.0.1", 0), [&](EventLoop &loop, TCPSocket &&socket) {
+        auto connection = make_shared<TCPSocket>(move(socket));
+        loop.add_rule(*connection, Direction::In, [&, connection] {
+            const string message = connection->read();
+            connection->close();
+            const lock_guard<mutex> lock(handled_mutex);
+            received.push_back(message);
+            threads.insert(this_thread::get_id());
+            if (received.size() == CONNECTIONS) {
+                done.set_value();
+            }
+        });
+    });
+    check(address.port() != 0, "listen() did not report the port");
+
+    vector<TCPSocket> clients(CONNECTIONS);
+    for (auto &client : clients) {
+        client.connect(address);
+        client.write("hello");
+    }
+
+    auto finished = done.get_future();
+    wait_for(finished, "connections to the shared port");
+    check(received == vector<string>(CONNECTIONS, "hello"), "connections to the shared port were not handled");
+    check(threads.count(this_thread::get_id()) == 0 and threads.size() <= group.size(),
+          "connections were not handled on the loops' threads");
+}
+
+// an exception on a loop's thread comes back from stop()
+static void test_error() {
+    EventLoopGroup group{2};
+    promise<void> started;
+    group.post(1, [&](EventLoop &) {
+        started.set_value();
+        throw runtime_error("task failed");
+    });
+    auto running = started.get_future();
+    wait_for(running, "failing task");
+    try {
+        group.stop();
+    } catch (const runtime_error &e) {
+        check(string(e.what()) == "task failed", "wrong exception from stop()");
+        return;
+    }
+    throw runtime_error("stop() did not rethrow the task's exception");
+}
+
+int main() {
+    try {
+        test_post();
+        test_producers();
+        test_dispatch(EventLoopGroup::Distribution::RoundRobin);
+        test_dispatch(EventLoopGroup::Distribution::Hash);
+        test_listen();
+        test_error();
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
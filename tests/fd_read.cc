@@ -0,0 +1,124 @@
+#include "file_descriptor.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <exception>
+#include <fcntl.h>
+#include <initializer_list>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+using namespace std;
+
+// a pipe as a (read end, write end) pair of FileDescriptors
+static pair<FileDescriptor, FileDescriptor> make_pipe() {
+    int fds[2];
+    SystemCall("pipe", ::pipe(fds));
+    return {FileDescriptor(fds[0]), FileDescriptor(fds[1])};
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+        auto [read_end, write_end] = make_pipe();
+
+        // small and large reads, into strings and into pooled Buffers
+        for (const size_t size : initializer_list<size_t>{1, 40, 4096, 4097, 60000, BufferPool::BLOCK_SIZE}) {
+            string data(size, 0);
+            generate(data.begin(), data.end(), [&] { return 'a' + (rd() % 26); });
+
+            write_end.write(data);
+            const Buffer buffer = read_end.read_buffer();
+            if (buffer.str() != data) {
+                throw runtime_error("read_buffer() returned the wrong bytes for a " + to_string(size) + "-byte read");
+            }
+
+            write_end.write(data);
+            string str(10, 'z');
+            read_end.read(str);
+            if (str != data) {
+                throw runtime_error("read(string &) returned the wrong bytes for a " + to_string(size) + "-byte read");
+            }
+        }
+
+        // limits are honored
+        write_end.write("abcdef");
+        if (read_end.read_buffer(2).str() != "ab" or read_end.read(3) != "cde" or read_end.read() != "f") {
+            throw runtime_error("read limit not honored");
+        }
+
+        // recycled blocks don't leak earlier contents into later reads
+        {
+            const string big(BufferPool::BLOCK_SIZE, 'x');
+            write_end.write(big);
+            read_end.read_buffer();
+            write_end.write(string(BufferPool::BLOCK_SIZE / 2, 'y'));
+            const Buffer buffer = read_end.read_buffer();
+            if (buffer.size() != BufferPool::BLOCK_SIZE / 2 or buffer.str().find('x') != string::npos) {
+                throw runtime_error("pooled Buffer exposes bytes beyond the read");
+            }
+        }
+
+        // a large read is spread over several pooled blocks, appended to what the BufferList already held
+        {
+            SystemCall("fcntl", ::fcntl(write_end.fd_num(), F_SETPIPE_SZ, 1 << 20));
+            string data(3 * BufferPool::BLOCK_SIZE + 1000, 0);
+            generate(data.begin(), data.end(), [&] { return 'a' + (rd() % 26); });
+            write_end.write(data);
+
+            BufferList buffers{string("head")};
+            if (read_end.read(buffers) != data.size() or buffers.concatenate() != "head" + data or
+                buffers.buffers().size() != 5) {
+                throw runtime_error("read(BufferList &) did not scatter a large read over pooled blocks");
+            }
+
+            write_end.write(data);
+            BufferList limited{};
+            if (read_end.read(limited, BufferPool::BLOCK_SIZE + 10) != BufferPool::BLOCK_SIZE + 10 or
+                limited.concatenate() != data.substr(0, BufferPool::BLOCK_SIZE + 10) or
+                read_end.read(limited) != data.size() - BufferPool::BLOCK_SIZE - 10 or limited.concatenate() != data) {
+                throw runtime_error("read(BufferList &) did not honor its limit");
+            }
+        }
+
+        // a write of more fragments than one writev takes, and larger than the pipe holds
+        {
+            string data(200000, 0);
+            generate(data.begin(), data.end(), [&] { return 'a' + (rd() % 26); });
+            BufferViewList views{};
+            for (size_t offset = 0; offset < data.size(); offset += 50) {
+                views.append(string_view(data).substr(offset, 50));
+            }
+            SystemCall("fcntl", ::fcntl(write_end.fd_num(), F_SETPIPE_SZ, 4096));
+            string received{};
+            thread reader([&] {
+                while (received.size() < data.size()) {
+                    received += read_end.read();
+                }
+            });
+            write_end.write(views);
+            reader.join();
+            if (received != data) {
+                throw runtime_error("write() of many fragments wrote the wrong bytes");
+            }
+        }
+
+        write_end.close();
+        BufferList at_eof{};
+        if (read_end.read(at_eof) != 0 or at_eof.size() != 0 or read_end.read_buffer().size() != 0 or
+            not read_end.eof()) {
+            throw runtime_error("expected EOF");
+        }
+
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,157 @@
+#include "address.hh"
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "socket.hh"
+#include "splice_relay.hh"
+#include "util.hh"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+using namespace std;
+
+static void check(const bool condition, const string &what) {
+    if (not condition) {
+        throw runtime_error(what);
+    }
+}
+
+// a pipe as a (read end, write end) pair of FileDescriptors
+static pair<FileDescriptor, FileDescriptor> make_pipe() {
+    int fds[2];
+    SystemCall("pipe", ::pipe(fds));
+    return {FileDescriptor(fds[0]), FileDescriptor(fds[1])};
+}
+
+// a connected pair of TCP sockets
+static pair<TCPSocket, TCPSocket> make_connection() {
+    TCPSocket listener;
+    listener.set_reuseaddr();
+    listener.bind(Address("127.0.0.1", 0));
+    listener.listen(1);
+    TCPSocket client;
+    client.connect(listener.local_address());
+    return {move(client), listener.accept()};
+}
+
+// read `socket` to EOF on another thread
+static thread read_all(TCPSocket &socket, string &received) {
+    return thread([&] {
+        while (not socket.eof()) {
+            received += socket.read();
+        }
+    });
+}
+
+static string make_data(const size_t size) {
+    string data(size, 0);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = 'a' + (i * 7 + i / 1000) % 26;
+    }
+    return data;
+}
+
+// a range of a file goes to a socket, and a range past the end of the file stops at the end
+static void test_sendfile() {
+    char path[] = "/tmp/sponge_fd_splice_XXXXXX";
+    FileDescriptor file{SystemCall("mkstemp", ::mkstemp(path))};
+    SystemCall("unlink", ::unlink(path));
+    const string data = make_data(3 << 20);
+    file.write(data);
+
+    auto [sender, receiver] = make_connection();
+    string received{};
+    thread reader = read_all(receiver, received);
+    const size_t sent = file.sendfile_to(sender, 1000, 2 << 20);
+    sender.shutdown(SHUT_WR);
+    reader.join();
+    check(sent == 2 << 20, "sendfile_to() sent the wrong number of bytes");
+    check(received == data.substr(1000, 2 << 20), "sendfile_to() sent the wrong bytes");
+
+    auto [read_end, write_end] = make_pipe();
+    check(file.sendfile_to(write_end, data.size() - 10, 100) == 10, "sendfile_to() went past the end of the file");
+    check(read_end.read() == data.substr(data.size() - 10), "sendfile_to() sent the wrong bytes at the end");
+}
+
+// a proxy relays one connection's bytes to another, and passes on the EOF
+static void test_relay(const EventLoop::Backend backend) {
+    auto [client, proxy_in] = make_connection();
+    auto [proxy_out, server] = make_connection();
+    const string data = make_data(4 << 20);
+
+    thread writer([&client = client, &data] {
+        client.write(data);
+        client.shutdown(SHUT_WR);
+    });
+    string received{};
+    thread reader = read_all(server, received);
+
+    EventLoop loop{backend};
+    SpliceRelay relay{};
+    loop.add_rule(
+        proxy_in,
+        Direction::In,
+        [&] { relay.fill(proxy_in); },
+        [&] { return not relay.full(); },
+        [&] {
+            if (relay.empty()) {
+                proxy_out.shutdown(SHUT_WR);
+            }
+        });
+    loop.add_rule(
+        proxy_out,
+        Direction::Out,
+        [&] {
+            relay.drain(proxy_out);
+            if (relay.empty() and proxy_in.eof()) {
+                proxy_out.shutdown(SHUT_WR);
+            }
+        },
+        [&] { return not relay.empty(); });
+
+    while (loop.wait_next_event(10000) == EventLoop::Result::Success) {
+    }
+    writer.join();
+    reader.join();
+    check(relay.empty() and relay.capacity() > 0, "relay did not drain");
+    check(received == data, "relay corrupted the data");
+}
+
+// a relay is full only when its pipe is, not when a non-blocking source has nothing to read
+static void test_relay_idle_source() {
+    auto [client, proxy_in] = make_connection();
+    proxy_in.set_blocking(false);
+    SpliceRelay relay{};
+
+    client.write("abc");
+    while (relay.buffered() < 3) {
+        relay.fill(proxy_in);
+    }
+    check(relay.fill(proxy_in) == 0 and not relay.full(), "relay with an idle source reported itself full");
+
+    client.set_blocking(false);
+    client.write(make_data(4 * relay.capacity()), false);
+    while (relay.fill(proxy_in) > 0) {
+    }
+    check(relay.full(), "relay with a full pipe did not report itself full");
+}
+
+int main() {
+    try {
+        test_sendfile();
+        test_relay_idle_source();
+        test_relay(EventLoop::Backend::Poll);
+        test_relay(EventLoop::Backend::EpollLevel);
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,209 @@
+#include "timer_wheel.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static void check(const bool condition, const string &what) {
+    if (not condition) {
+        throw runtime_error(what);
+    }
+}
+
+// each timer fires at the first call to expire() at or after its deadline, at every level of the wheel
+static void test_levels() {
+    const uint64_t start = 123456;
+    TimerWheel wheel{start};
+    const vector<uint64_t> delays{0, 1, 5, 255, 256, 300, 65535, 65536, 70000, (1 << 24) + 7, (1ull << 33) + 11};
+
+    uint64_t now = start;
+    vector<uint64_t> fired_at(delays.size(), 0);
+    for (size_t i = 0; i < delays.size(); ++i) {
+        wheel.add(start + delays[i], [&, i] { fired_at[i] = now; });
+    }
+    check(wheel.size() == delays.size(), "wrong size after adding");
+
+    for (size_t i = 0; i < delays.size(); ++i) {
+        const uint64_t deadline = start + delays[i];
+        check(wheel.next_deadline().value() <= deadline, "next_deadline is after a pending deadline");
+        if (deadline > now) {
+            now = deadline - 1;
+            wheel.expire(now);
+            check(fired_at[i] == 0, "timer fired early (delay " + to_string(delays[i]) + ")");
+        }
+        now = deadline;
+        wheel.expire(now);
+        check(fired_at[i] == deadline, "timer did not fire on time (delay " + to_string(delays[i]) + ")");
+    }
+    check(wheel.empty() and not wheel.next_deadline().has_value(), "wheel not empty after every timer fired");
+}
+
+// timers can be canceled, including from callbacks and in the batch being expired
+static void test_cancel() {
+    TimerWheel wheel{0};
+    unsigned fired = 0;
+
+    const auto early = wheel.add(5000, [&] { ++fired; });
+    check(wheel.cancel(early) and not wheel.cancel(early), "cancel should succeed exactly once");
+
+    // two timers due at the same tick, each of which cancels the other: only one fires
+    TimerWheel::TimerId a = 0, b = 0;
+    a = wheel.add(10, [&] {
+        ++fired;
+        wheel.cancel(b);
+    });
+    b = wheel.add(10, [&] {
+        ++fired;
+        wheel.cancel(a);
+    });
+    wheel.expire(20);
+    check(fired == 1, "timer canceled in its own batch still fired");
+    check(not wheel.cancel(a) and not wheel.cancel(b), "cancel should fail after the timer fired");
+    check(wheel.empty(), "wheel not empty");
+
+    // a stale id does not cancel the timer that reuses its node
+    const auto c = wheel.add(30, [&] { ++fired; });
+    check(not wheel.cancel(early) and not wheel.cancel(a) and not wheel.cancel(b), "stale ids canceled something");
+    check(wheel.size() == 1 and wheel.cancel(c), "live timer was lost");
+}
+
+// a callback may add timers, even ones whose deadline has passed
+static void test_rearm() {
+    TimerWheel wheel{0};
+    uint64_t now = 0;
+    vector<uint64_t> ticks{};
+    function<void()> tick = [&] {
+        ticks.push_back(now);
+        if (ticks.size() < 5) {
+            wheel.add(now, tick);  // already due: fires at the next call to expire
+        }
+    };
+    wheel.add(3, tick);
+    for (now = 0; now < 10; ++now) {
+        wheel.expire(now);
+    }
+    check(ticks == vector<uint64_t>{3, 4, 5, 6, 7}, "re-armed timer fired at the wrong times");
+}
+
+// a timer waiting in a higher level's slot is not lost when the wheel stops at that slot's start and
+// a timer is then added to level 0 (regression)
+static void test_uncascaded_slot() {
+    TimerWheel wheel{0};
+    vector<uint64_t> fired{};
+    uint64_t now = 0;
+
+    wheel.add(0x105, [&] { fired.push_back(0x105); });
+    now = 0xFF;
+    wheel.expire(now);  // stops at 0x100, before level 1's slot 1 has been cascaded
+    wheel.add(0x110, [&] { fired.push_back(0x110); });
+    check(wheel.next_deadline().value() <= 0x105, "next_deadline is after the earliest deadline");
+
+    for (const uint64_t time : {0x106, 0x200, 0x100000}) {
+        now = time;
+        wheel.expire(now);
+        if (now == 0x106) {
+            check(fired == vector<uint64_t>{0x105}, "timer in an uncascaded slot did not fire on time");
+        }
+    }
+    check(fired == vector<uint64_t>{0x105, 0x110}, "timers were lost");
+    check(wheel.empty() and not wheel.next_deadline().has_value(), "wheel not empty after every timer fired");
+}
+
+// timers added at random between calls to expire(), at random distances, against a simple model
+static void test_random_interleaved() {
+    auto rd = get_random_generator();
+    uint64_t now = rd() % (1ull << 40);
+    TimerWheel wheel{now};
+
+    vector<uint64_t> deadlines{};
+    vector<uint64_t> fired_at{};
+    for (unsigned round = 0; round < 2000; ++round) {
+        for (unsigned i = rd() % 3; i > 0; --i) {
+            const size_t index = deadlines.size();
+            deadlines.push_back(now + 1 + rd() % (1ull << (rd() % 26)));
+            fired_at.push_back(0);
+            wheel.add(deadlines.back(), [&, index] { fired_at[index] = now; });
+        }
+        const auto next = wheel.next_deadline();
+        for (size_t i = 0; i < deadlines.size(); ++i) {
+            if (fired_at[i] == 0) {
+                check(next.has_value() and next.value() <= deadlines[i], "next_deadline is after a pending deadline");
+            }
+        }
+
+        const uint64_t previous = now;
+        now += 1 + rd() % (1 << (rd() % 18));
+        wheel.expire(now);
+        for (size_t i = 0; i < deadlines.size(); ++i) {
+            const bool due = deadlines[i] <= now, fired_before = fired_at[i] != 0 and fired_at[i] <= previous;
+            check(fired_before or (due ? fired_at[i] == now : fired_at[i] == 0), "timer fired at the wrong time");
+        }
+    }
+}
+
+// many timers, canceled and expired at random, against a simple model
+static void test_random() {
+    auto rd = get_random_generator();
+    const uint64_t start = rd() % (1ull << 40);
+    TimerWheel wheel{start};
+
+    struct Expected {
+        uint64_t deadline;
+        TimerWheel::TimerId id;
+        bool canceled;
+    };
+    vector<Expected> timers{};
+    vector<pair<uint64_t, uint64_t>> fired{};  // (time of the previous expire() call, time of the call that fired it)
+    uint64_t previous = start - 1, now = start;
+
+    constexpr size_t COUNT = 100000;
+    timers.reserve(COUNT);
+    fired.resize(COUNT, {0, 0});
+    for (size_t i = 0; i < COUNT; ++i) {
+        const uint64_t deadline = start + (rd() % (1ull << (rd() % 28)));
+        timers.push_back({deadline, wheel.add(deadline, [&, i] { fired[i] = {previous, now}; }), false});
+    }
+    for (size_t i = 0; i < COUNT; i += 3) {
+        timers[i].canceled = wheel.cancel(timers[i].id);
+    }
+
+    while (not wheel.empty()) {
+        now = previous + 1 + rd() % (1 << (rd() % 20));
+        wheel.expire(now);
+        previous = now;
+    }
+
+    for (size_t i = 0; i < COUNT; ++i) {
+        if (timers[i].canceled) {
+            check(fired[i].second == 0, "canceled timer fired");
+        } else {
+            // fired by the first call to expire() at or after the deadline
+            check(fired[i].first < timers[i].deadline and timers[i].deadline <= fired[i].second,
+                  "timer fired at the wrong time");
+        }
+    }
+}
+
+int main() {
+    try {
+        test_levels();
+        test_cancel();
+        test_rearm();
+        test_uncascaded_slot();
+        test_random_interleaved();
+        test_random();
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+#include "address.hh"
+#include "buffer.hh"
+#include "socket.hh"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+static void check(const bool condition, const string &what) {
+    if (not condition) {
+        throw runtime_error(what);
+    }
+}
+
+int main() {
+    try {
+        UDPSocket receiver;
+        receiver.bind(Address("127.0.0.1", 0));
+        const Address destination = receiver.local_address();
+
+        UDPSocket sender;
+        sender.bind(Address("127.0.0.1", 0));
+
+        // a batch of datagrams, some with multi-part payloads, goes out in order
+        vector<string> payloads{};
+        vector<UDPSocket::outgoing_datagram> outgoing{};
+        for (unsigned i = 0; i < 40; ++i) {
+            payloads.push_back("datagram " + to_string(i) + string(i * 10, 'x'));
+        }
+        for (const auto &payload : payloads) {
+            BufferViewList views{string_view(payload).substr(0, 5)};
+            views.append(string_view(payload).substr(5));
+            outgoing.push_back({destination, views});
+        }
+        check(sender.send_batch(outgoing) == outgoing.size(), "send_batch() did not send every datagram");
+
+        // ... and comes back in batches no larger than the storage provided
+        vector<UDPSocket::received_datagram> datagrams(16, {Address("0.0.0.0"), string()});
+        vector<string> received{};
+        while (received.size() < payloads.size()) {
+            const size_t count = receiver.recv_batch(datagrams, 1500);
+            check(count > 0 and count <= datagrams.size(), "recv_batch() returned a bad count");
+            for (size_t i = 0; i < count; ++i) {
+                check(datagrams[i].source_address == sender.local_address(), "wrong source address");
+                received.push_back(datagrams[i].payload);
+            }
+        }
+        check(received == payloads, "datagrams were lost, reordered or corrupted");
+
+        // a segmented send arrives as ordinary datagrams, and more than 64 segments take several sends
+        // (here, of a payload whose views do not line up with the segments or the sends)
+        string bulk(100 * 200 + 123, 0);
+        for (size_t i = 0; i < bulk.size(); ++i) {
+            bulk[i] = 'a' + i % 26;
+        }
+        BufferViewList pieces{string_view(bulk).substr(0, 7777)};
+        pieces.append(string_view(bulk).substr(7777, 6000));
+        pieces.append(string_view(bulk).substr(13777));
+        sender.sendto_segmented(destination, pieces, 200);
+        string reassembled{};
+        while (reassembled.size() < bulk.size()) {
+            const size_t count = receiver.recv_batch(datagrams, 1500);
+            for (size_t i = 0; i < count; ++i) {
+                const size_t expected = min(bulk.size() - reassembled.size(), size_t(200));
+                check(datagrams[i].payload.size() == expected, "segment has the wrong size");
+                check(datagrams[i].segment_size == expected, "uncoalesced datagram reported a segment size");
+                reassembled += datagrams[i].payload;
+            }
+        }
+        check(reassembled == bulk, "segmented payload was corrupted");
+
+        // with GRO, the receiver may get the segments back coalesced, reporting their size
+        receiver.set_gro(true);
+        sender.sendto_segmented(destination, bulk, 200);
+        reassembled.clear();
+        while (reassembled.size() < bulk.size()) {
+            const auto datagram = receiver.recv();
+            check(datagram.segment_size > 0 and datagram.segment_size <= 200, "wrong segment size");
+            check(datagram.payload.size() % 200 == 0 or reassembled.size() + datagram.payload.size() == bulk.size(),
+                  "coalesced payload is not made of whole segments");
+            reassembled += datagram.payload;
+        }
+        check(reassembled == bulk, "coalesced payload was corrupted");
+        receiver.set_gro(false);
+
+        // a non-blocking socket with nothing waiting returns an empty batch
+        receiver.set_blocking(false);
+        check(receiver.recv_batch(datagrams) == 0, "recv_batch() found a datagram that was not sent");
+
+        // a datagram larger than the mtu is an error, not a silently truncated payload
+        const string oversized(2000, 'y');
+        sender.send_batch({{destination, oversized}});
+        receiver.set_blocking(true);
+        try {
+            receiver.recv_batch(datagrams, 1500);
+        } catch (const runtime_error &) {
+            return EXIT_SUCCESS;
+        }
+        throw runtime_error("recv_batch() accepted an oversized datagram");
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+}